@@ -4,9 +4,27 @@
 /*
   Build Instructions:
   PATH=../build/:${PATH}
-  clang -std=c99 -Wall -Wextra aoc-23-d1.c  -O3 -g -o ../build/aoc-23-d1
+  clang -std=c99 -Wall -Wextra -pthread aoc-23-d1.c aoc-input.c  -O3 -g -o ../build/aoc-23-d1
+  Benchmark build, run with --bench as the first argument (see aoc-bench.h):
+  clang -std=c99 -Wall -Wextra -pthread -DBENCH aoc-23-d1.c aoc-input.c aoc-bench.c  -O3 -g -o ../build/aoc-23-d1-bench
+  Instrumented build, counters printed on stderr at exit (see aoc-instr.h):
+  clang -std=c99 -Wall -Wextra -pthread -DAOC_INSTRUMENT aoc-23-d1.c aoc-input.c  -O3 -g -o ../build/aoc-23-d1-instr
 
   Program written for the Advent of Code day 1 2023
+  A single read of the input gives both answers: the numerals only total (part 1)
+  and the total which also counts the spelled out digits (part 2).
+
+  Usage: aoc-23-d1 [--words VOCABULARY] [--threads N] [--read-ahead] [FILENAME]
+  The optional vocabulary file replaces the english digit names. Each line holds a
+  word and the digit value it stands for, e.g. "eins 1".
+  Where one word is a prefix of another, the longer one counts in both directions:
+  with the vocabulary "../../data/aoc-23-d1-prefix-words.txt" ("on 5", "one 1", ...)
+  the line "one" is worth 11, and "../../data/aoc-23-d1-prefix.txt" gives
+  part 1: 110 part 2: 205
+  With --threads the input is split into N ranges of whole lines summed in parallel.
+  With --read-ahead the input is read in large blocks while the blocks already read
+  are summed by N threads (1 by default), see aoc_read_ahead.
+  FILENAME "-" reads standard input.
  */
 
 #include <ctype.h>
@@ -14,7 +32,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#include "aoc-input.h"
+#include "aoc-instr.h"
+#ifdef BENCH
+#include "aoc-bench.h"
+#endif
 //#define VALUE(digit) ((digit) - (int) '0') /* Convert the digit ascii code to the digit's value  */
+#define ALPHABET 256 /* one transition per byte value */
+#define MAX_WORD_LENGTH 64 /* longest word accepted from a vocabulary file */
+#define VOCABULARY_LINE_LENGTH 1024
+#define MAX_THREADS 256
 
 #ifdef TEST
 char const fname[] = "../../data/tmp.dat";
@@ -23,184 +51,521 @@ char const fname[] = "../../data/aoc-23-d1.txt";
 #endif
 
 char *numbers[] = {"one", "two", "three", "four", "five", "six", "seven", "eight", "nine"};
-static bool match_str_from_file_maybe(FILE *f, char const *str);
-static int match_num_maybe(FILE *f, int c);
-static bool is_first_char_of_digit_name(char c);
 
-int main(void)
+/* A word recognised on reaching a state: len == 0 means no word ends there */
+struct match
 {
-    FILE *f = fopen(fname, "r");
-    int *p = malloc(sizeof(int));
-    long sum = 0;
+    int value;
+    int len;
+};
 
-    /* the scan state variables: must be reset to these values at the beginning of each line */
-    int first = 0;
-    int last = 0;
-    bool isFirst = true;
+/*
+  Aho-Corasick automaton over the vocabulary (digit names and the digits themselves),
+  compiled into a dense DFA. Every byte costs one table lookup and the input is never
+  backed up, so overlapping words such as "eightwo" need no rewinding.
+ */
+struct automaton
+{
+    int *delta;            /* delta[state * ALPHABET + byte] is the next state */
+    struct match *longest; /* longest word which is a suffix of the text read so far */
+    int nstates;
+    int capacity;
+};
+
+/*
+  The forward automaton finds the first digit of a line, the automaton over the
+  reversed words finds the last digit scanning back from the end of the line.
+ */
+struct matcher
+{
+    struct automaton fwd;
+    struct automaton rev;
+    int maxlen; /* length of the longest word */
+};
+
+/* Totals produced by a single read of the input */
+struct calibration
+{
+    long digits; /* counting the numerals only */
+    long words;  /* counting the numerals and the spelled out digits */
+};
+
+static void automaton_init(struct automaton *a);
+static void automaton_add_word(struct automaton *a, char const *word, int value);
+static void automaton_compile(struct automaton *a);
+static void automaton_destroy(struct automaton *a);
+static void matcher_init(struct matcher *m);
+static void matcher_add_word(struct matcher *m, char const *word, int value);
+static void matcher_compile(struct matcher *m);
+static void matcher_destroy(struct matcher *m);
+static void vocabulary_load(struct matcher *m, char const *vocab_fname);
+static void matcher_build(struct matcher *m, char const *vocab);
+static struct calibration calibration_sum(struct matcher const *m, char const *buf, size_t len);
+static struct calibration calibration_sum_parallel(struct matcher const *m, char const *buf, size_t len, int nthreads);
+static struct calibration calibration_sum_read_ahead(struct matcher const *m, char const *fname, int nthreads);
+#ifdef BENCH
+static int bench_main(int argc, char *argv[]);
+#endif
 
-    /* scan line to deterine the first and last integer */
-    do
+int main(int argc, char *argv[])
+{
+#ifdef BENCH
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
     {
-        while ((*p = fgetc(f)) != '\n') /* keep scanning until end of line reached */
+        return bench_main(argc, argv);
+    }
+#endif
+    char const *input = fname;
+    char const *vocab = NULL;
+    int nthreads = 1;
+    bool read_ahead = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--words") && i + 1 < argc)
         {
-            if (*p == EOF) /* Check for end of file and terminate this loop */
-            {            
-                break;
-            }
-            else if (isalpha(*p))
-            {
-                *p = match_num_maybe(f, (char) *p); /* try to match a number in word form */                
-            }
-
-            if (isdigit(*p)) /* at this point p is either a number or the next character of a non number word */
+            vocab = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--read-ahead"))
+        {
+            read_ahead = true;
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            nthreads = atoi(argv[++i]);
+            if (nthreads < 1 || nthreads > MAX_THREADS)
             {
-                if (isFirst)
-                {
-                    first = *p - '0';
-                    last = first;
-                    isFirst = false;
-                }
-                else
-                    {
-                        last = *p - '0';    
-                    }
+                fprintf(stderr, "[ERROR:] Thread count must be between 1 and %i\n", MAX_THREADS);
+                exit(EXIT_FAILURE);
             }
-        } /* Keep scanning characters until newline reached. EOF is handled specially within the loop */
-
-        /* Compute the running total for all lines scanned so far */
-        sum += (first * 10 + last);
-
-        if (*p == EOF) /* Check for EOF and terminate this loop */
+        }
+        else if (argv[i][0] != '-' || !argv[i][1])
         {
-            break;            
+            input = argv[i];
         }
+        else
+        {
+            fprintf(stderr, "USAGE: %s [--words VOCABULARY] [--threads N] [--read-ahead] [FILENAME]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        /* reset the scan state variables */
-        isFirst = true;
-        first = 0;
-        last = 0;
+    AOC_PHASE_BEGIN(build);
+    struct matcher m;
+    matcher_build(&m, vocab);
+    AOC_PHASE_END(build);
+
+    AOC_PHASE_BEGIN(sum);
+    struct calibration sum;
+    if (read_ahead)
+    {
+        sum = calibration_sum_read_ahead(&m, input, nthreads);
     }
-    while (true); /* Keep scanning lines until end of file reached */
+    else
+    {
+        struct aoc_input in = aoc_input_open(input, 0);
+        sum = (nthreads > 1) ? calibration_sum_parallel(&m, in.data, in.len, nthreads)
+                             : calibration_sum(&m, in.data, in.len);
+        aoc_input_close(&in);
+    }
+    AOC_PHASE_END(sum);
 
-    /* Print the result */
-    printf("The sum is %li\n", sum);
-    if (p) free(p);
+    /* Print the results */
+    printf("The sum of the numerals only is %li\n", sum.digits);
+    printf("The sum is %li\n", sum.words);
+    matcher_destroy(&m);
     return EXIT_SUCCESS;
 }
 
+/* Build the matcher once: digit names (or the loaded vocabulary) plus the digits */
+static void matcher_build(struct matcher *m, char const *vocab)
+{
+    matcher_init(m);
+    if (vocab)
+    {
+        vocabulary_load(m, vocab);
+    }
+    else
+    {
+        for (int i = 0; i < 9; i++)
+        {
+            matcher_add_word(m, numbers[i], i + 1);
+        }
+    }
+    for (int d = 0; d <= 9; d++)
+    {
+        char const digit[2] = {(char) ('0' + d), '\0'};
+        matcher_add_word(m, digit, d);
+    }
+    matcher_compile(m);
+}
+
 /*
-  Try match string str, with the corresponding character's in the stream.
-  If the match fails rewind the stream to remain unchanged from when the
-  function was invoked.
+  Line kernel: the first digit is the match starting leftmost, found scanning forward
+  from the beginning of the line; the last digit is the match starting rightmost,
+  found scanning the reversed words backward from the end of the line. Of two words
+  starting at the same byte ("on" and "one") both scans take the longer. The numerals
+  only totals are tracked alongside, so each scan stops once both of its digits are
+  known. Bytes between the matches are never looked at.
 */
-static bool match_str_from_file_maybe(FILE *f, char const *str)
+static struct calibration line_value(struct matcher const *m, char const *beg, char const *end)
 {
-    int const len = strlen(str);
-    char history[6] = "";
-    char c;
-    for (int i = 0; i < len; i++) { /* match str with characters from stream f */
-        c = fgetc(f);
-        history[i] = c;
-        if (isalpha(c))
+    int first = 0;
+    int first_digit = 0;
+    char const *first_start = NULL;
+    bool digit_found = false;
+    int state = 0;
+    for (char const *p = beg; p < end; p++)
+    {
+        state = m->fwd.delta[state * ALPHABET + (unsigned char) *p];
+        struct match const w = m->fwd.longest[state];
+        /* a word found later with the same start is longer: the longest wins, as backward */
+        if (w.len && (!first_start || p + 1 - w.len <= first_start))
+        {
+            first = w.value;
+            first_start = p + 1 - w.len;
+        }
+        if (!digit_found && isdigit((unsigned char) *p))
+        {
+            first_digit = *p - '0';
+            digit_found = true;
+        }
+        /* a word starting at or before first_start must have ended by now */
+        if (digit_found && p - first_start >= m->maxlen - 1)
         {
-            c = tolower(c);
+            break;
         }
+    }
+    if (!first_start)
+    {
+        return (struct calibration) {0, 0}; /* no digit on this line */
+    }
 
-        if (c != str[i])
-        { /* case: no match found */
-            for (int j = i; j >= 0; j--) /* rewind */
-            {
-                ungetc(history[j], f);
-            }
-            return false;
-        } /* no match */
-    } /* match characters loop */
-    /* match found */
-    if (is_first_char_of_digit_name(c)) 
+    /* a reversed word is recognised at its original start, rightmost start first */
+    int last = -1;
+    int last_digit = -1;
+    state = 0;
+    for (char const *p = end; p > beg && (last < 0 || (digit_found && last_digit < 0)); p--)
     {
-        ungetc(c, f); /* Could be the start of digit name */
+        state = m->rev.delta[state * ALPHABET + (unsigned char) p[-1]];
+        struct match const w = m->rev.longest[state];
+        if (w.len && last < 0)
+        {
+            last = w.value;
+        }
+        if (last_digit < 0 && isdigit((unsigned char) p[-1]))
+        {
+            last_digit = p[-1] - '0';
+        }
     }
+    return (struct calibration) {
+        .digits = digit_found ? first_digit * 10 + last_digit : 0,
+        .words = first * 10 + last
+    };
+}
 
-    return true; /* case: match found */
+/* Sum the calibration values, one line at a time */
+static struct calibration calibration_sum(struct matcher const *m, char const *buf, size_t len)
+{
+    struct calibration sum = {0, 0};
+    struct aoc_lines it = aoc_lines_of(buf, len);
+    char const *p;
+    size_t n;
+    AOC_INSTR(unsigned long long lines = 0;)
+    while (aoc_lines_next(&it, &p, &n))
+    {
+        AOC_INSTR(lines++;)
+        /* Compute the running totals for all lines scanned so far */
+        struct calibration const line = line_value(m, p, p + n);
+        sum.digits += line.digits;
+        sum.words += line.words;
+    }
+    AOC_COUNT("d1 lines", lines);
+    AOC_COUNT("d1 bytes", len);
+    return sum;
 }
 
-/* Match a number written in characters and return the corresponding character code, 
-   or return the next character from the file
- */
+/* Partial sums of the worker threads, one slot per worker so none of them locks */
+struct worker_sums
+{
+    struct matcher const *m;
+    struct calibration sum[MAX_THREADS];
+};
+
+static void span_sum(void *ctx, char const *data, size_t len, int worker)
+{
+    struct worker_sums *r = ctx;
+    struct calibration const part = calibration_sum(r->m, data, len);
+    r->sum[worker].digits += part.digits;
+    r->sum[worker].words += part.words;
+}
+
+static struct calibration worker_sums_total(struct worker_sums const *r, int nthreads)
+{
+    struct calibration sum = {0, 0};
+    for (int i = 0; i < nthreads; i++)
+    {
+        sum.digits += r->sum[i].digits;
+        sum.words += r->sum[i].words;
+    }
+    return sum;
+}
 
-static int match_num_maybe(FILE *f, int c)
+/* Sum nthreads ranges of whole lines of the buffer, each on its own thread */
+static struct calibration calibration_sum_parallel(struct matcher const *m, char const *buf, size_t len, int nthreads)
 {
-    c = tolower(c);
-    switch (c)
+    struct worker_sums r = {.m = m};
+    aoc_parallel_lines(buf, len, nthreads, span_sum, &r);
+    return worker_sums_total(&r, nthreads);
+}
+
+/* Sum the blocks handed over by the read-ahead pipeline as they arrive */
+static struct calibration calibration_sum_read_ahead(struct matcher const *m, char const *fname, int nthreads)
+{
+    struct worker_sums r = {.m = m};
+    aoc_read_ahead(fname, nthreads, span_sum, &r);
+    return worker_sums_total(&r, nthreads);
+}
+
+static void automaton_init(struct automaton *a)
+{
+    a->nstates = 1; /* the root */
+    a->capacity = 64;
+    a->delta = malloc(sizeof(int) * ALPHABET * a->capacity);
+    a->longest = calloc(a->capacity, sizeof(struct match));
+    if (!a->delta || !a->longest)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, automaton not created\n");
+        exit(2);
+    }
+    for (int c = 0; c < ALPHABET; c++)
+    {
+        a->delta[c] = -1;
+    }
+}
+
+static int automaton_new_state(struct automaton *a)
+{
+    if (a->nstates == a->capacity)
     {
-        case 'o':
-        if (match_str_from_file_maybe(f, "ne"))
+        a->capacity *= 2;
+        a->delta = realloc(a->delta, sizeof(int) * ALPHABET * a->capacity);
+        a->longest = realloc(a->longest, sizeof(struct match) * a->capacity);
+        AOC_ALLOC("d1 automaton growth", (sizeof(int) * ALPHABET + sizeof(struct match)) * a->capacity);
+        if (!a->delta || !a->longest)
         {
-            return '1';
+            fprintf(stderr, "[ERROR:] Memory Error, automaton not grown\n");
+            exit(2);
         }
-        break;
-        case 't':
-        if (match_str_from_file_maybe(f, "wo"))
+    }
+    int const s = a->nstates++;
+    for (int c = 0; c < ALPHABET; c++)
+    {
+        a->delta[s * ALPHABET + c] = -1;
+    }
+    a->longest[s] = (struct match) {0, 0};
+    return s;
+}
+
+/* Add a word to the trie; matching is case insensitive */
+static void automaton_add_word(struct automaton *a, char const *word, int value)
+{
+    int s = 0;
+    int len = 0;
+    for (char const *p = word; *p; p++, len++)
+    {
+        int const c = tolower((unsigned char) *p);
+        if (a->delta[s * ALPHABET + c] < 0)
         {
-            return '2';
+            int const t = automaton_new_state(a); /* may move delta */
+            a->delta[s * ALPHABET + c] = t;
         }
-        else if (match_str_from_file_maybe(f, "hree"))
+        s = a->delta[s * ALPHABET + c];
+    }
+    if (len)
+    {
+        a->longest[s] = (struct match) {value, len};
+    }
+}
+
+/*
+  Turn the trie into a DFA: a breadth first walk computes the failure links, fills in
+  every missing transition from the failure state and lets each state inherit the
+  words ending at its failure state.
+ */
+static void automaton_compile(struct automaton *a)
+{
+    int *fail = malloc(sizeof(int) * a->nstates);
+    int *queue = malloc(sizeof(int) * a->nstates);
+    if (!fail || !queue)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, automaton not compiled\n");
+        exit(2);
+    }
+    int head = 0;
+    int tail = 0;
+    for (int c = 0; c < ALPHABET; c++)
+    {
+        int const t = a->delta[c];
+        if (t < 0)
         {
-            return '3';
+            a->delta[c] = 0;
         }
-        break;
-        case 'f':
-        if (match_str_from_file_maybe(f, "our"))
+        else
         {
-            return '4';
+            fail[t] = 0;
+            queue[tail++] = t;
         }
-        if (match_str_from_file_maybe(f, "ive"))
+    }
+    while (head < tail)
+    {
+        int const s = queue[head++];
+        for (int c = 0; c < ALPHABET; c++)
         {
-            return '5';
+            int const t = a->delta[s * ALPHABET + c];
+            int const f = a->delta[fail[s] * ALPHABET + c];
+            if (t < 0)
+            {
+                a->delta[s * ALPHABET + c] = f;
+                continue;
+            }
+            fail[t] = f;
+            if (!a->longest[t].len)
+            {
+                a->longest[t] = a->longest[f];
+            }
+            queue[tail++] = t;
         }
-        break;
-        case 's':
-        if (match_str_from_file_maybe(f, "ix"))
+    }
+    /* upper case letters behave like their lower case counterparts */
+    for (int s = 0; s < a->nstates; s++)
+    {
+        for (int c = 'A'; c <= 'Z'; c++)
         {
-            return '6';
+            a->delta[s * ALPHABET + c] = a->delta[s * ALPHABET + tolower(c)];
         }
-        else if (match_str_from_file_maybe(f, "even"))
+    }
+    free(fail);
+    free(queue);
+}
+
+static void automaton_destroy(struct automaton *a)
+{
+    free(a->delta);
+    free(a->longest);
+}
+
+static void matcher_init(struct matcher *m)
+{
+    automaton_init(&m->fwd);
+    automaton_init(&m->rev);
+    m->maxlen = 0;
+}
+
+/* Add a word to the forward automaton and its reversal to the backward one */
+static void matcher_add_word(struct matcher *m, char const *word, int value)
+{
+    char reversed[MAX_WORD_LENGTH];
+    int const len = strlen(word);
+    if (len >= MAX_WORD_LENGTH)
+    {
+        fprintf(stderr, "[ERROR:] Word %s is too long\n", word);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < len; i++)
+    {
+        reversed[i] = word[len - 1 - i];
+    }
+    reversed[len] = '\0';
+    automaton_add_word(&m->fwd, word, value);
+    automaton_add_word(&m->rev, reversed, value);
+    m->maxlen = (len > m->maxlen) ? len : m->maxlen;
+}
+
+static void matcher_compile(struct matcher *m)
+{
+    automaton_compile(&m->fwd);
+    automaton_compile(&m->rev);
+}
+
+static void matcher_destroy(struct matcher *m)
+{
+    automaton_destroy(&m->fwd);
+    automaton_destroy(&m->rev);
+}
+
+/* Load "word value" pairs, one per line */
+static void vocabulary_load(struct matcher *m, char const *vocab_fname)
+{
+    FILE *f = fopen(vocab_fname, "r");
+    if (!f)
+    {
+        fprintf(stderr, "[ERROR:] Could not open vocabulary %s\n", vocab_fname);
+        exit(EXIT_FAILURE);
+    }
+    char line[VOCABULARY_LINE_LENGTH];
+    char word[VOCABULARY_LINE_LENGTH]; /* as long as the line, the word length is checked by matcher_add_word */
+    for (int lineno = 1; fgets(line, sizeof(line), f); lineno++)
+    {
+        if (!strchr(line, '\n') && !feof(f))
         {
-            return '7';
+            fprintf(stderr, "[ERROR:] %s:%i: line too long\n", vocab_fname, lineno);
+            exit(EXIT_FAILURE);
         }
-        break;
-        case 'e':
-        if (match_str_from_file_maybe(f, "ight"))
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line))
         {
-            return '8';
+            continue; /* blank line */
         }
-        break;
-        case 'n':
-        if (match_str_from_file_maybe(f, "ine"))
+        int value;
+        char extra;
+        if (sscanf(line, "%s %i %c", word, &value, &extra) != 2 || value < 0 || value > 9)
         {
-            return '9';
+            fprintf(stderr, "[ERROR:] %s:%i: expected a word and a digit value, got \"%s\"\n", vocab_fname, lineno, line);
+            exit(EXIT_FAILURE);
         }
-        break;
-        default:
-        return c;
+        matcher_add_word(m, word, value);
     }
-    return c;
+    fclose(f);
 }
 
-static bool is_first_char_of_digit_name(char c)
+#ifdef BENCH
+/* One benchmark iteration: map the input, build the matcher, sum the lines */
+struct bench_ctx
 {
-    switch(tolower(c))
-    {
-        case 'e':
-        case 'f':
-        case 'o':
-        case 'n':
-        case 's':
-        case 't':
-        return true;
-        break;
-        default:
-        break;
-    }
-    return false;
+    char const *fname;
+    int nthreads;
+    volatile long sink; /* keeps the answers alive */
+};
+
+static void bench_iteration(struct aoc_bench *b, void *arg)
+{
+    struct bench_ctx *ctx = arg;
+    aoc_bench_begin(b, 0);
+    struct aoc_input in = aoc_input_open(ctx->fname, 0);
+    aoc_bench_end(b, 0);
+
+    aoc_bench_begin(b, 1);
+    struct matcher m;
+    matcher_build(&m, NULL);
+    aoc_bench_end(b, 1); /* the lines are decoded while they are summed, in solve */
+
+    aoc_bench_begin(b, 2);
+    struct calibration const sum = (ctx->nthreads > 1) ? calibration_sum_parallel(&m, in.data, in.len, ctx->nthreads)
+                                                       : calibration_sum(&m, in.data, in.len);
+    aoc_bench_end(b, 2);
+
+    aoc_bench_input_size(b, in.len, aoc_bench_count_lines(in.data, in.len));
+    ctx->sink += sum.digits + sum.words;
+    matcher_destroy(&m);
+    aoc_input_close(&in);
 }
+
+static int bench_main(int argc, char *argv[])
+{
+    struct aoc_bench_config const cfg = aoc_bench_parse_args(argc, argv, MAX_THREADS);
+    char const *const phases[] = {"load", "build", "solve"};
+    struct bench_ctx ctx = {.fname = cfg.input ? cfg.input : fname, .nthreads = cfg.threads, .sink = 0};
+    aoc_bench_run("d1", &cfg, phases, 3, bench_iteration, &ctx);
+    return EXIT_SUCCESS;
+}
+#endif
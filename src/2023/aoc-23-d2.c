@@ -4,23 +4,55 @@
 /*
   Build Instructions:
   PATH=../build/:${PATH}
-  clang -std=c99 -Wall -Wextra aoc-23-d2.c  -O3 -g -o ../build/aoc-23-d2
+  clang -std=c99 -Wall -Wextra -pthread aoc-23-d2.c aoc-input.c  -O3 -g -o ../build/aoc-23-d2
+  Benchmark build, run with --bench as the first argument (see aoc-bench.h):
+  clang -std=c99 -Wall -Wextra -pthread -DBENCH aoc-23-d2.c aoc-input.c aoc-bench.c  -O3 -g -o ../build/aoc-23-d2-bench
+  Instrumented build, counters printed on stderr at exit (see aoc-instr.h):
+  clang -std=c99 -Wall -Wextra -pthread -DAOC_INSTRUMENT aoc-23-d2.c aoc-input.c  -O3 -g -o ../build/aoc-23-d2-instr
 
   Program written for the Advent of Code day 2 2023
+
+  Usage: aoc-23-d2 [--stream [--every N] | [--read-ahead] --threads N] [--limits LIMITS] [--cache] [FILENAME]
+  FILENAME defaults to RESULT_FILENAME, "-" reads standard input. With --stream each
+  game is reduced to its minimal set as soon as its line is complete and then dropped,
+  so memory stays constant and a growing log can be followed through a pipe; --every
+  prints the running totals after every N games. With --threads the mapped input is
+  split into N ranges of whole lines, each reduced the same way by its own thread;
+  adding --read-ahead has the N threads reduce large blocks of lines while the next
+  ones are being read instead (see aoc_read_ahead).
+  --limits answers a batch of bag configurations instead of the one in the
+  specification: each line of LIMITS holds the number of red, green and blue cubes,
+  blank lines are skipped and any other line is an error.
+  --cache keeps the parsed games and their minimal sets in FILENAME.cache, a binary
+  image which later runs map directly instead of parsing the text again.
  */
 
+#define _POSIX_C_SOURCE 200809L /* stat, st_mtim */
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include "aoc-input.h"
+#include "aoc-instr.h"
+#ifdef BENCH
+#include "aoc-bench.h"
+#endif
 /* No of Cubes per specification */
 #define NO_OF_RED 12 
 #define NO_OF_GREEN 13  
 #define NO_OF_BLUE 14
 #define RESULT_FILENAME "../../data/aoc-d2.dat"
-#define MAX_SETS 7 /* use: awk -F\;  '{ print NF }' ../data/aoc-d2.dat| sort | tail -n 1 */
-#define MAX_LINE_LENGTH 200 /* awk -F\\n  '{ print length }' ../data/aoc-d2.dat | uniq | sort */
+#define INITIAL_GAMES 256 /* initial capacity of the game store, it doubles as needed */
+#define INITIAL_SETS 1024
+#define LIMITS_LINE_LENGTH 256
+#define QUERY_BLOCK 4096 /* games tested against every query while they are in cache */
+#define CACHE_MAGIC "AOC23D2\2" /* 8 bytes, the last one is the format version */
+#define CACHE_SUFFIX ".cache"
+#define MAX_THREADS 256
 
 typedef struct
 {
@@ -29,152 +61,552 @@ typedef struct
     int blue;
 } GameSet;
 
+/*
+  Structure of arrays holding every game. The sets of game i are the entries
+  set_off[i] .. set_off[i + 1] - 1 of the colour columns, so games of any length take
+  no padding. All the columns live in a single arena which grows by doubling and is
+  released with one free.
+ */
 typedef struct
 {
-    int id;
-    GameSet results[MAX_SETS];
-} GameRecord;
+    char *arena;
+    size_t ngames;
+    size_t nsets;
+    size_t games_cap;
+    size_t sets_cap;
+    size_t *set_off; /* games_cap + 1 entries */
+    int *ids;        /* games_cap entries */
+    int *red;        /* sets_cap entries each */
+    int *green;
+    int *blue;
+} GameStore;
 
-typedef struct GameElem
-{    
-    GameRecord *rec;
-    struct GameElem *next;
-} GameElem;
+/* Read position within the mapped input: the parser never copies or modifies it */
+typedef struct
+{
+    char const *p;
+    char const *end;
+} Cursor;
+
+/*
+  Minimal set of every game, one column per colour. Computed once, it answers any
+  number of bag limit queries without looking at the individual sets again.
+ */
+typedef struct
+{
+    size_t ngames;
+    int *ids;
+    int *red;
+    int *green;
+    int *blue;
+    void *block; /* owns the columns, NULL when they are mapped from a cache */
+} MinimalSets;
+
+/*
+  Header of the binary cache. It is followed by the columns of the game store
+  (set_off, ids, red, green, blue) and of the minimal sets (ids, red, green, blue),
+  each one stored contiguously in that order. The cache is valid while the source
+  keeps its size and mtime, to the nanosecond; if only the mtime changed, the hash
+  of the source text decides. So does it when the source is not older than the cache
+  file: a rewrite within the same timestamp tick would leave the mtime unchanged.
+ */
+typedef struct
+{
+    char magic[8];
+    uint64_t word_size; /* sizeof(size_t) of the writer */
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash; /* FNV-1a of the source text */
+    uint64_t ngames;
+    uint64_t nsets;
+} CacheHeader;
+
+/* The answers, accumulated one game at a time */
+typedef struct
+{
+    size_t ngames;
+    long cumsum;   /* sum of the ids of the possible games */
+    long powersum; /* sum of the powers of the minimal sets */
+} Totals;
 
-static int scan_line(FILE *f, GameRecord *rec);
-static GameSet set_create_from_string(char const *setstr);
+static void game_store_init(GameStore *store);
+static void game_store_destroy(GameStore *store);
+static void game_store_add_game(GameStore *store, int id);
+static void game_store_add_set(GameStore *store, GameSet set);
+static bool scan_game(Cursor *c, GameStore *store);
+static bool scan_game_minimal(Cursor *c, int *id, GameSet *minimal);
+static void totals_add(Totals *t, int id, GameSet minimal);
+static Totals stream_games(char const *fname, size_t every);
+static Totals reduce_games_parallel(char const *data, size_t len, int nthreads);
+static Totals reduce_games_read_ahead(char const *fname, int nthreads);
+#ifdef TEST
 static void set_print(GameSet set);
-static void game_list_print(GameElem *list);
-static GameSet game_minimal_set(GameRecord const * const rec);
+static void game_store_print(GameStore const *store);
+#endif
+static GameSet game_minimal_set(GameStore const *store, size_t game);
 static int set_power(GameSet set);
+static MinimalSets minimal_sets_create(GameStore const *store);
+static void minimal_sets_destroy(MinimalSets *m);
+static void bag_query_batch(MinimalSets const *m, GameSet const *limits, long *sums, size_t nqueries);
+static GameSet *limits_load(char const *fname, size_t *nqueries);
+static bool cache_load(char const *fname, GameStore *store, MinimalSets *minimal, struct aoc_input *cache_in);
+static void cache_write(char const *fname, char const *data, size_t len, GameStore const *store, MinimalSets const *minimal);
+#ifdef BENCH
+static int bench_main(int argc, char *argv[]);
+#endif
 
-int main(void)
+int main(int argc, char *argv[])
 {
-    char const fname[] = RESULT_FILENAME;
-    FILE *f = fopen(fname, "r");
-    int res;
-    GameElem *game_list = NULL;
-    GameElem *iter = NULL;
-    bool first = true;
-    do
+#ifdef BENCH
+    if (argc > 1 && !strcmp(argv[1], "--bench"))
+    {
+        return bench_main(argc, argv);
+    }
+#endif
+    char const *fname = RESULT_FILENAME;
+    char const *limits_fname = NULL;
+    bool stream = false;
+    bool cache = false;
+    bool read_ahead = false;
+    size_t every = 0;
+    int nthreads = 0;
+    for (int i = 1; i < argc; i++)
     {
-        GameRecord *rec = malloc(sizeof(GameRecord)); /* allocate record */
-        res = scan_line(f, rec); /* Fill record from the database file */
-        if (res != EOF) /* add record to the game list */
+        if (!strcmp(argv[i], "--stream"))
         {
-            GameElem *el = malloc(sizeof(GameElem));
-            if (first)
+            stream = true;
+        }
+        else if (!strcmp(argv[i], "--cache"))
+        {
+            cache = true;
+        }
+        else if (!strcmp(argv[i], "--read-ahead"))
+        {
+            read_ahead = true;
+        }
+        else if (!strcmp(argv[i], "--limits") && i + 1 < argc)
+        {
+            limits_fname = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--every") && i + 1 < argc)
+        {
+            every = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            nthreads = atoi(argv[++i]);
+            if (nthreads < 1 || nthreads > MAX_THREADS)
             {
-                game_list = el;
-                first = false;
-                iter = game_list; /* create and initialise list iterator */
-                el->rec = rec;
-                el->next = NULL;
+                fprintf(stderr, "[ERROR:] Thread count must be between 1 and %i\n", MAX_THREADS);
+                exit(EXIT_FAILURE);
             }
-            else
-                {
-                    el->rec = rec;
-                    el->next = NULL;
-                    iter->next = el;
-                    iter = iter->next;
-                }
+        }
+        else if (argv[i][0] != '-' || !argv[i][1])
+        {
+            fname = argv[i];
         }
         else
-            {
-                break;
-            }
+        {
+            fprintf(stderr, "USAGE: %s [--stream [--every N] | [--read-ahead] --threads N] [--limits LIMITS] [--cache] [FILENAME]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    nthreads = (read_ahead && !nthreads) ? 1 : nthreads;
+    if ((stream || nthreads) && (limits_fname || cache || (stream && nthreads)))
+    {
+        fprintf(stderr, "[ERROR:] --stream and --threads only compute the two answers\n");
+        exit(EXIT_FAILURE);
     }
-    while (true); /* The loop is terminated from within the body on reaching EOF  */
 
-    /* Print records */
-    // game_list_print(game_list);    
+    if (stream)
+    {
+        Totals const t = stream_games(fname, every);
+        printf("The sum of the possible game ids is: %li\n", t.cumsum);
+        printf("The cumulative power of the minimal games is %li\n", t.powersum);
+        return EXIT_SUCCESS;
+    }
 
-    /* Iterate over game_list and see if the minimal set of the game is within the specification bounds */
-    GameSet minimal;
-    int cumsum = 0;
-    int powersum = 0;
-    iter = game_list;
-    while (iter) /* while more games in gamelist */
+    if (read_ahead)
     {
-        minimal = game_minimal_set(iter->rec);
-        if (minimal.red <= NO_OF_RED && minimal.green <= NO_OF_GREEN && minimal.blue <= NO_OF_BLUE)
+        Totals const t = reduce_games_read_ahead(fname, nthreads);
+        printf("The sum of the possible game ids is: %li\n", t.cumsum);
+        printf("The cumulative power of the minimal games is %li\n", t.powersum);
+        return EXIT_SUCCESS;
+    }
+
+    if (nthreads)
+    {
+        struct aoc_input in = aoc_input_open(fname, 0);
+        Totals const t = reduce_games_parallel(in.data, in.len, nthreads);
+        printf("The sum of the possible game ids is: %li\n", t.cumsum);
+        printf("The cumulative power of the minimal games is %li\n", t.powersum);
+        aoc_input_close(&in);
+        return EXIT_SUCCESS;
+    }
+
+    cache = cache && strcmp(fname, "-");
+    GameStore store;
+    MinimalSets minimal;
+    struct aoc_input cache_in = {.data = "", .len = 0, .map_len = 0, .buf = NULL};
+    AOC_PHASE_BEGIN(load);
+    if (!cache || !cache_load(fname, &store, &minimal, &cache_in))
+    {
+        struct aoc_input in = aoc_input_open(fname, 0);
+        Cursor c = {.p = in.data, .end = in.data + in.len};
+        game_store_init(&store);
+        while (scan_game(&c, &store)) /* Fill the store from the database file */
         {
-            cumsum += iter->rec->id;
         }
-        powersum += set_power(minimal);
-        iter = iter->next;
+        AOC_COUNT("d2 games", store.ngames);
+        AOC_COUNT("d2 sets", store.nsets);
+
+        /* Reduce every game to its minimal set once, then answer the bag limit queries */
+        minimal = minimal_sets_create(&store);
+        if (cache)
+        {
+            cache_write(fname, in.data, in.len, &store, &minimal);
+        }
+        aoc_input_close(&in);
     }
-    printf("The sum of the possible game ids is: %i\n", cumsum);
-    printf("The cumulative power of the minimal games is %i\n", powersum);
-    /* Destroy records */
-    iter = game_list;
-    while(iter) /* while more elements in game list */
+    else
     {
-        if (iter->rec)
+        AOC_COUNT("d2 cache hits", 1);
+    }
+    AOC_PHASE_END(load);
+
+#ifdef TEST
+    game_store_print(&store); /* Print records */
+#endif
+
+    AOC_PHASE_BEGIN(answer);
+    long powersum = 0;
+    for (size_t i = 0; i < minimal.ngames; i++)
+    {
+        powersum += set_power((GameSet) {minimal.red[i], minimal.green[i], minimal.blue[i]});
+    }
+
+    if (limits_fname)
+    {
+        size_t nqueries;
+        GameSet *limits = limits_load(limits_fname, &nqueries);
+        long *sums = malloc(sizeof(long) * (nqueries ? nqueries : 1));
+        bag_query_batch(&minimal, limits, sums, nqueries);
+        for (size_t q = 0; q < nqueries; q++)
         {
-            free(iter->rec); /* Destroy the element's record */
+            printf("%i red, %i green, %i blue: the sum of the possible game ids is %li\n",
+                   limits[q].red, limits[q].green, limits[q].blue, sums[q]);
         }
-        GameElem *prev_iter = iter;
-        iter = iter->next; /* move to the next container */
-        free(prev_iter); /* Destroy the current list element */
+        free(sums);
+        free(limits);
+    }
+    else
+    {
+        GameSet const spec = {.red = NO_OF_RED, .green = NO_OF_GREEN, .blue = NO_OF_BLUE};
+        long cumsum;
+        bag_query_batch(&minimal, &spec, &cumsum, 1);
+        printf("The sum of the possible game ids is: %li\n", cumsum);
     }
+    printf("The cumulative power of the minimal games is %li\n", powersum);
+    AOC_PHASE_END(answer);
+    /* Destroy records */
+    minimal_sets_destroy(&minimal);
+    game_store_destroy(&store);
+    aoc_input_close(&cache_in);
 
     return EXIT_SUCCESS;
 }
 
-static int scan_line(FILE *f, GameRecord *rec )
+/* Lay the columns out in a new arena big enough for the given capacities */
+static void game_store_reserve(GameStore *store, size_t games_cap, size_t sets_cap)
 {
-    char line[MAX_LINE_LENGTH];
-    char garbage[12];
-    int res = fscanf(f, "%s %i:%[^\n]\n", garbage, &(rec->id), line);
-    if (res == EOF) return res;    
-    int i =  0;
-    char sep[2] = ";";
-    char *setstr, *brkt;
-    for (setstr = strtok_r(line, sep, &brkt); setstr; setstr = strtok_r(NULL, sep, &brkt))
+    size_t const size = sizeof(size_t) * (games_cap + 1) + sizeof(int) * (games_cap + 3 * sets_cap);
+    char *arena = malloc(size);
+    AOC_ALLOC("d2 game store", size);
+    if (!arena)
     {
-        rec->results[i] = set_create_from_string(setstr);
-        i++;
+        fprintf(stderr, "[ERROR:] Memory Error, game store not grown\n");
+        exit(2);
     }
-    return res;
+    size_t *set_off = (size_t *) arena;
+    int *ids = (int *) (set_off + games_cap + 1);
+    int *red = ids + games_cap;
+    int *green = red + sets_cap;
+    int *blue = green + sets_cap;
+    if (store->arena)
+    {
+        memcpy(set_off, store->set_off, sizeof(size_t) * (store->ngames + 1));
+        memcpy(ids, store->ids, sizeof(int) * store->ngames);
+        memcpy(red, store->red, sizeof(int) * store->nsets);
+        memcpy(green, store->green, sizeof(int) * store->nsets);
+        memcpy(blue, store->blue, sizeof(int) * store->nsets);
+        free(store->arena);
+    }
+    else
+    {
+        set_off[0] = 0;
+    }
+    *store = (GameStore) {
+        .arena = arena, .ngames = store->ngames, .nsets = store->nsets,
+        .games_cap = games_cap, .sets_cap = sets_cap,
+        .set_off = set_off, .ids = ids, .red = red, .green = green, .blue = blue
+    };
 }
 
-static GameSet set_create_from_string(char const *setstr)
+static void game_store_init(GameStore *store)
 {
-    GameSet set = {.red = 0, .blue = 0, .green = 0};
-    char str[MAX_LINE_LENGTH];
-    strcpy(str, setstr);
-    int count = 0;
-    char col[6]; /* red, green, or blue */
-    char sep[2] = ",";
-    char *brkt;
-    for (char *setstr2  = strtok_r(str, sep, &brkt); setstr2; setstr2 = strtok_r(NULL, sep, &brkt))
+    *store = (GameStore) {.arena = NULL, .ngames = 0, .nsets = 0};
+    game_store_reserve(store, INITIAL_GAMES, INITIAL_SETS);
+}
+
+static void game_store_destroy(GameStore *store)
+{
+    free(store->arena);
+    store->arena = NULL;
+}
+
+/* Start a new game: the sets added next belong to it */
+static void game_store_add_game(GameStore *store, int id)
+{
+    if (store->ngames == store->games_cap)
+    {
+        game_store_reserve(store, 2 * store->games_cap, store->sets_cap);
+    }
+    store->ids[store->ngames] = id;
+    store->ngames++;
+    store->set_off[store->ngames] = store->nsets;
+}
+
+/* Append a set to the last game of the store */
+static void game_store_add_set(GameStore *store, GameSet set)
+{
+    if (store->nsets == store->sets_cap)
     {
-        sscanf(setstr2, "%i %s,", &count, col); 
-        if (!strcmp("red", col))
+        game_store_reserve(store, store->games_cap, 2 * store->sets_cap);
+    }
+    store->red[store->nsets] = set.red;
+    store->green[store->nsets] = set.green;
+    store->blue[store->nsets] = set.blue;
+    store->nsets++;
+    store->set_off[store->ngames] = store->nsets;
+}
+
+static void skip_blanks(Cursor *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r'))
+    {
+        c->p++;
+    }
+}
+
+static int parse_int(Cursor *c)
+{
+    skip_blanks(c);
+    int n = 0;
+    while (c->p < c->end && (unsigned) (*c->p - '0') < 10)
+    {
+        n = n * 10 + (*c->p - '0');
+        c->p++;
+    }
+    return n;
+}
+
+/* Skip "Game" and read the id up to the colon: false once the input is exhausted */
+static bool parse_game_header(Cursor *c, int *id)
+{
+    while (c->p < c->end && !isdigit((unsigned char) *c->p))
+    {
+        c->p++;
+    }
+    if (c->p == c->end)
+    {
+        return false;
+    }
+    *id = parse_int(c);
+    skip_blanks(c);
+    if (c->p < c->end && *c->p == ':')
+    {
+        c->p++;
+    }
+    return true;
+}
+
+/*
+  Parse "3 blue, 4 red" up to and including the separator which ends the set, the
+  colour is decided by its first letter. Returns the separator: ';' when another set
+  of the same game follows.
+ */
+static char parse_set(Cursor *c, GameSet *set)
+{
+    *set = (GameSet) {.red = 0, .green = 0, .blue = 0};
+    while (c->p < c->end)
+    {
+        int const count = parse_int(c);
+        skip_blanks(c);
+        char const colour = (c->p < c->end) ? *c->p : '\0';
+        while (c->p < c->end && isalpha((unsigned char) *c->p))
         {
-            if (count > set.red)
-            {
-                set.red = count;
-            }
+            c->p++;
         }
-        else if (!strcmp("blue", col))
+        switch (colour)
         {
-            if (count > set.blue)
-            {
-                set.blue = count;
-            }            
+            case 'r':
+            if (count > set->red) set->red = count;
+            break;
+            case 'g':
+            if (count > set->green) set->green = count;
+            break;
+            case 'b':
+            if (count > set->blue) set->blue = count;
+            break;
+            default:
+            break;
+        }
+        skip_blanks(c);
+        if (c->p == c->end)
+        {
+            break;
         }
-        else if (!strcmp("green", col))
+        char const sep = *c->p++;
+        if (sep != ',')
         {
-            if (count > set.green)
+            return sep;
+        }
+    }
+    return '\n';
+}
+
+/* Parse one game line into the store: false once the input is exhausted */
+static bool scan_game(Cursor *c, GameStore *store)
+{
+    int id;
+    if (!parse_game_header(c, &id))
+    {
+        return false;
+    }
+    game_store_add_game(store, id);
+    GameSet set;
+    char sep;
+    do
+    {
+        sep = parse_set(c, &set);
+        game_store_add_set(store, set);
+    }
+    while (sep == ';');
+    while (sep != '\n' && c->p < c->end) /* skip whatever could not be parsed */
+    {
+        sep = *c->p++;
+    }
+    return true;
+}
+
+/* Parse one game line keeping only its minimal set: false once the input is exhausted */
+static bool scan_game_minimal(Cursor *c, int *id, GameSet *minimal)
+{
+    if (!parse_game_header(c, id))
+    {
+        return false;
+    }
+    *minimal = (GameSet) {.red = 0, .green = 0, .blue = 0};
+    GameSet set;
+    char sep;
+    do
+    {
+        sep = parse_set(c, &set);
+        minimal->red = (set.red > minimal->red) ? set.red : minimal->red;
+        minimal->green = (set.green > minimal->green) ? set.green : minimal->green;
+        minimal->blue = (set.blue > minimal->blue) ? set.blue : minimal->blue;
+    }
+    while (sep == ';');
+    while (sep != '\n' && c->p < c->end) /* skip whatever could not be parsed */
+    {
+        sep = *c->p++;
+    }
+    return true;
+}
+
+static void totals_add(Totals *t, int id, GameSet minimal)
+{
+    if (minimal.red <= NO_OF_RED && minimal.green <= NO_OF_GREEN && minimal.blue <= NO_OF_BLUE)
+    {
+        t->cumsum += id;
+    }
+    t->powersum += set_power(minimal);
+    t->ngames++;
+}
+
+/*
+  Streaming mode: reduce the complete lines read so far and keep only the unfinished
+  tail, memory stays constant unless a single line does not fit the read buffer.
+ */
+static Totals stream_games(char const *fname, size_t every)
+{
+    Totals t = {.ngames = 0, .cumsum = 0, .powersum = 0};
+    struct aoc_reader r = aoc_reader_open(fname);
+    char const *data;
+    size_t len;
+    while (aoc_reader_next(&r, &data, &len))
+    {
+        Cursor c = {.p = data, .end = data + len};
+        int id;
+        GameSet minimal;
+        while (scan_game_minimal(&c, &id, &minimal))
+        {
+            totals_add(&t, id, minimal);
+            if (every && t.ngames % every == 0)
             {
-                set.green = count;
-            }            
+                printf("After %zu games: ids %li, power %li\n", t.ngames, t.cumsum, t.powersum);
+                fflush(stdout);
+            }
         }
     }
-    return set;
+    aoc_reader_close(&r);
+    AOC_COUNT("d2 games streamed", t.ngames);
+    return t;
 }
+
+/* Helper function for the threaded reductions: each worker adds up its own totals */
+static void span_reduce(void *ctx, char const *data, size_t len, int worker)
+{
+    Totals *t = (Totals *) ctx + worker;
+    Cursor c = {.p = data, .end = data + len};
+    int id;
+    GameSet minimal;
+    while (scan_game_minimal(&c, &id, &minimal))
+    {
+        totals_add(t, id, minimal);
+    }
+}
+
+static Totals totals_merge(Totals const *partial, int nthreads)
+{
+    Totals t = {.ngames = 0, .cumsum = 0, .powersum = 0};
+    for (int i = 0; i < nthreads; i++)
+    {
+        t.ngames += partial[i].ngames;
+        t.cumsum += partial[i].cumsum;
+        t.powersum += partial[i].powersum;
+    }
+    return t;
+}
+
+/* Reduce nthreads ranges of whole lines of the input, each on its own thread */
+static Totals reduce_games_parallel(char const *data, size_t len, int nthreads)
+{
+    Totals partial[MAX_THREADS] = {{0, 0, 0}};
+    aoc_parallel_lines(data, len, nthreads, span_reduce, partial);
+    return totals_merge(partial, nthreads);
+}
+
+/* Reduce the blocks handed over by the read-ahead pipeline as they arrive */
+static Totals reduce_games_read_ahead(char const *fname, int nthreads)
+{
+    Totals partial[MAX_THREADS] = {{0, 0, 0}};
+    aoc_read_ahead(fname, nthreads, span_reduce, partial);
+    return totals_merge(partial, nthreads);
+}
+
+#ifdef TEST
 static void set_print(GameSet set)
 {
     if (set.red)
@@ -201,56 +633,53 @@ static void set_print(GameSet set)
     }
 }
 
-static void game_print(GameRecord *rec)
+static void game_print(GameStore const *store, size_t game)
 {
-    bool first = true;
-    printf("Game %i: ", rec->id);
-    for (int i = 0; i < MAX_SETS; i++)
+    printf("Game %i: ", store->ids[game]);
+    for (size_t i = store->set_off[game]; i < store->set_off[game + 1]; i++)
     {
-        GameSet set = rec->results[i];
-        if (set.red > 0 || set.blue > 0 || set.red > 0)
+        if (i > store->set_off[game])
         {
-            if (!first)
-            {
-                printf("; "); /* semicolon only printed at beginning of second through last set */
-            }
-            else
-                {
-                    first = false;
-                }
-            set_print(set);   
+            printf("; "); /* semicolon only printed at beginning of second through last set */
         }
+        set_print((GameSet) {.red = store->red[i], .green = store->green[i], .blue = store->blue[i]});
     }
     printf("\n");
 }
 
-static void game_list_print (GameElem *list)
+static void game_store_print(GameStore const *store)
 {
-    GameElem *iter = list;
-    while (iter != NULL)
+    for (size_t i = 0; i < store->ngames; i++)
     {
-        game_print(iter->rec);
-        iter = iter->next;
+        game_print(store, i);
     }
 }
+#endif
 
 /* return a set representing the maximum value of each colour of ball seen in any set of that game */
-static GameSet game_minimal_set(GameRecord const * const rec)
+static GameSet game_minimal_set(GameStore const *store, size_t game)
 {
     GameSet max_set = {0, 0, 0};
-    for (int i = 0; i < MAX_SETS; i++)
+    size_t const end = store->set_off[game + 1];
+    for (size_t i = store->set_off[game]; i < end; i++) /* one colour column at a time */
     {
-        if (max_set.red  < rec->results[i].red)
+        if (max_set.red < store->red[i])
         {
-            max_set.red = rec->results[i].red;
+            max_set.red = store->red[i];
         }
-        if (max_set.green  < rec->results[i].green)
+    }
+    for (size_t i = store->set_off[game]; i < end; i++)
+    {
+        if (max_set.green < store->green[i])
         {
-            max_set.green = rec->results[i].green;
+            max_set.green = store->green[i];
         }
-        if (max_set.blue  < rec->results[i].blue)
+    }
+    for (size_t i = store->set_off[game]; i < end; i++)
+    {
+        if (max_set.blue < store->blue[i])
         {
-            max_set.blue = rec->results[i].blue;
+            max_set.blue = store->blue[i];
         }
     }
     return max_set;
@@ -260,3 +689,372 @@ static int set_power(GameSet set)
 {
     return set.red * set.blue * set.green;
 }
+
+/* Columns of the minimal sets of all games, allocated as one block */
+static MinimalSets minimal_sets_create(GameStore const *store)
+{
+    size_t const n = store->ngames;
+    MinimalSets m = {.ngames = n};
+    m.ids = m.block = malloc(sizeof(int) * 4 * (n ? n : 1));
+    AOC_ALLOC("d2 minimal sets", sizeof(int) * 4 * (n ? n : 1));
+    if (!m.ids)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, minimal sets not created\n");
+        exit(2);
+    }
+    m.red = m.ids + n;
+    m.green = m.red + n;
+    m.blue = m.green + n;
+    for (size_t i = 0; i < n; i++)
+    {
+        GameSet const minimal = game_minimal_set(store, i);
+        m.ids[i] = store->ids[i];
+        m.red[i] = minimal.red;
+        m.green[i] = minimal.green;
+        m.blue[i] = minimal.blue;
+    }
+    return m;
+}
+
+static void minimal_sets_destroy(MinimalSets *m)
+{
+    free(m->block);
+    m->block = NULL;
+}
+
+/*
+  For every bag limit sum the ids of the games whose minimal set fits in the bag.
+  Games are taken a block at a time and the block is tested against every query
+  while it is in cache. The inner loop has no branches so the compiler turns it
+  into vector compares and masked adds over the colour columns.
+ */
+static void bag_query_batch(MinimalSets const *m, GameSet const *limits, long *sums, size_t nqueries)
+{
+    for (size_t q = 0; q < nqueries; q++)
+    {
+        sums[q] = 0;
+    }
+    for (size_t beg = 0; beg < m->ngames; beg += QUERY_BLOCK)
+    {
+        size_t const end = (beg + QUERY_BLOCK < m->ngames) ? beg + QUERY_BLOCK : m->ngames;
+        for (size_t q = 0; q < nqueries; q++)
+        {
+            int const red = limits[q].red;
+            int const green = limits[q].green;
+            int const blue = limits[q].blue;
+            long sum = 0;
+            for (size_t i = beg; i < end; i++)
+            {
+                int const fits = (m->red[i] <= red) & (m->green[i] <= green) & (m->blue[i] <= blue);
+                sum += m->ids[i] & -fits;
+            }
+            sums[q] += sum;
+        }
+    }
+}
+
+/* Read "red green blue" limits, one bag per line */
+static GameSet *limits_load(char const *fname, size_t *nqueries)
+{
+    FILE *f = fopen(fname, "r");
+    if (!f)
+    {
+        fprintf(stderr, "[ERROR:] Could not open %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    size_t cap = 64;
+    GameSet *limits = malloc(sizeof(GameSet) * cap);
+    char line[LIMITS_LINE_LENGTH];
+    *nqueries = 0;
+    for (int lineno = 1; limits && fgets(line, sizeof(line), f); lineno++)
+    {
+        if (!strchr(line, '\n') && !feof(f))
+        {
+            fprintf(stderr, "[ERROR:] %s:%i: line too long\n", fname, lineno);
+            exit(EXIT_FAILURE);
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line))
+        {
+            continue; /* blank line */
+        }
+        GameSet l;
+        char extra;
+        if (sscanf(line, "%i %i %i %c", &l.red, &l.green, &l.blue, &extra) != 3 || l.red < 0 || l.green < 0 || l.blue < 0)
+        {
+            fprintf(stderr, "[ERROR:] %s:%i: expected the red, green and blue cube counts, got \"%s\"\n", fname, lineno, line);
+            exit(EXIT_FAILURE);
+        }
+        if (*nqueries == cap)
+        {
+            limits = realloc(limits, sizeof(GameSet) * (cap *= 2));
+            if (!limits)
+            {
+                break;
+            }
+        }
+        limits[(*nqueries)++] = l;
+    }
+    if (!limits)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, limits not loaded\n");
+        exit(2);
+    }
+    fclose(f);
+    return limits;
+}
+
+static uint64_t fnv1a(char const *data, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static char *cache_name(char const *fname)
+{
+    char *name = malloc(strlen(fname) + sizeof(CACHE_SUFFIX));
+    if (!name)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, cache name not created\n");
+        exit(2);
+    }
+    strcpy(name, fname);
+    strcat(name, CACHE_SUFFIX);
+    return name;
+}
+
+static size_t cache_size(uint64_t ngames, uint64_t nsets)
+{
+    return sizeof(CacheHeader) + sizeof(size_t) * (ngames + 1) + sizeof(int) * (5 * ngames + 3 * nsets);
+}
+
+/* Helper function for cache_load: rewrite the header of a cache in place */
+static void cache_header_update(char const *name, CacheHeader const *h)
+{
+    FILE *f = fopen(name, "r+b");
+    bool const ok = f && fwrite(h, sizeof(*h), 1, f) == 1;
+    if ((f && fclose(f)) || !ok)
+    {
+        fprintf(stderr, "[WARNING:] Could not update %s\n", name);
+    }
+}
+
+/* Helper function for cache_load: the game offsets must describe the stored sets */
+static bool cache_offsets_valid(size_t const *set_off, size_t ngames, size_t nsets)
+{
+    if (set_off[0] != 0 || set_off[ngames] != nsets)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < ngames; i++)
+    {
+        if (set_off[i] > set_off[i + 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Helper function for cache_load: a is before b */
+static bool timespec_before(struct timespec a, struct timespec b)
+{
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+/*
+  Map a valid cache of fname and point the store and the minimal sets into it.
+  Returns false, leaving nothing mapped, when there is no cache or it is stale.
+ */
+static bool cache_load(char const *fname, GameStore *store, MinimalSets *minimal, struct aoc_input *cache_in)
+{
+    struct stat src;
+    struct stat st;
+    char *name = cache_name(fname);
+    bool const exists = !stat(fname, &src) && !stat(name, &st) && (size_t) st.st_size >= sizeof(CacheHeader);
+    struct aoc_input in = {.data = "", .len = 0, .map_len = 0, .buf = NULL};
+    if (exists)
+    {
+        in = aoc_input_open(name, 0);
+    }
+    char const *const data = in.data;
+    size_t const len = in.len;
+    if (!exists)
+    {
+        free(name);
+        return false;
+    }
+
+    CacheHeader h;
+    memcpy(&h, data, sizeof(h));
+    bool valid = !memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) && h.word_size == sizeof(size_t)
+        && h.source_size == (uint64_t) src.st_size && h.ngames < len && h.nsets < len
+        && len == cache_size(h.ngames, h.nsets);
+    bool const touched = h.source_mtime_sec != (int64_t) src.st_mtim.tv_sec
+        || h.source_mtime_nsec != (int64_t) src.st_mtim.tv_nsec;
+    if (valid && (touched || !timespec_before(src.st_mtim, st.st_mtim)))
+    {
+        struct aoc_input src_in = aoc_input_open(fname, 0); /* compare the text itself */
+        valid = fnv1a(src_in.data, src_in.len) == h.source_hash;
+        aoc_input_close(&src_in);
+        if (valid) /* record the mtime, the rewrite also dates the cache after the source */
+        {
+            h.source_mtime_sec = src.st_mtim.tv_sec;
+            h.source_mtime_nsec = src.st_mtim.tv_nsec;
+            cache_header_update(name, &h);
+        }
+    }
+    free(name);
+    valid = valid && cache_offsets_valid((size_t const *) (data + sizeof(CacheHeader)), h.ngames, h.nsets);
+    if (!valid)
+    {
+        aoc_input_close(&in);
+        return false;
+    }
+
+    /* The mapping is read only: nothing is ever added to a store loaded from a cache */
+    size_t const ngames = h.ngames;
+    size_t const nsets = h.nsets;
+    size_t *set_off = (size_t *) (data + sizeof(CacheHeader));
+    int *ids = (int *) (set_off + ngames + 1);
+    *store = (GameStore) {
+        .arena = NULL, .ngames = ngames, .nsets = nsets, .games_cap = ngames, .sets_cap = nsets,
+        .set_off = set_off, .ids = ids, .red = ids + ngames, .green = ids + ngames + nsets,
+        .blue = ids + ngames + 2 * nsets
+    };
+    int *columns = ids + ngames + 3 * nsets;
+    *minimal = (MinimalSets) {
+        .ngames = ngames, .ids = columns, .red = columns + ngames, .green = columns + 2 * ngames,
+        .blue = columns + 3 * ngames, .block = NULL
+    };
+    *cache_in = in;
+    return true;
+}
+
+/* Write the cache next to a temporary name and rename it, so readers never see half of it */
+static void cache_write(char const *fname, char const *data, size_t len, GameStore const *store, MinimalSets const *minimal)
+{
+    struct stat src;
+    if (stat(fname, &src))
+    {
+        return;
+    }
+    CacheHeader h = {
+        .word_size = sizeof(size_t), .source_size = len,
+        .source_mtime_sec = src.st_mtim.tv_sec, .source_mtime_nsec = src.st_mtim.tv_nsec,
+        .source_hash = fnv1a(data, len), .ngames = store->ngames, .nsets = store->nsets
+    };
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+
+    char *name = cache_name(fname);
+    char *tmp = malloc(strlen(name) + 5);
+    if (!tmp)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, cache not written\n");
+        exit(2);
+    }
+    strcpy(tmp, name);
+    strcat(tmp, ".tmp");
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "[WARNING:] Could not write %s\n", tmp);
+        free(tmp);
+        free(name);
+        return;
+    }
+    size_t const n = store->ngames;
+    size_t const m = store->nsets;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(store->set_off, sizeof(size_t), n + 1, f) == n + 1
+        && fwrite(store->ids, sizeof(int), n, f) == n
+        && fwrite(store->red, sizeof(int), m, f) == m
+        && fwrite(store->green, sizeof(int), m, f) == m
+        && fwrite(store->blue, sizeof(int), m, f) == m
+        && fwrite(minimal->ids, sizeof(int), n, f) == n
+        && fwrite(minimal->red, sizeof(int), n, f) == n
+        && fwrite(minimal->green, sizeof(int), n, f) == n
+        && fwrite(minimal->blue, sizeof(int), n, f) == n;
+    ok = !fclose(f) && ok && !rename(tmp, name);
+    if (!ok)
+    {
+        fprintf(stderr, "[WARNING:] Could not write %s\n", name);
+        remove(tmp);
+    }
+    free(tmp);
+    free(name);
+}
+
+#ifdef BENCH
+struct bench_ctx
+{
+    char const *fname;
+    int nthreads;
+    volatile long sink; /* keeps the answers alive */
+};
+
+/*
+  One benchmark iteration: map the input, fill the game store, then reduce the games
+  and answer the specification. With more than one thread the threads parse and
+  reduce their ranges in one pass, timed as the solve phase.
+ */
+static void bench_iteration(struct aoc_bench *b, void *arg)
+{
+    struct bench_ctx *ctx = arg;
+    aoc_bench_begin(b, 0);
+    struct aoc_input in = aoc_input_open(ctx->fname, 0);
+    aoc_bench_end(b, 0);
+    aoc_bench_input_size(b, in.len, aoc_bench_count_lines(in.data, in.len));
+
+    if (ctx->nthreads > 1)
+    {
+        aoc_bench_begin(b, 1);
+        aoc_bench_end(b, 1);
+        aoc_bench_begin(b, 2);
+        Totals const t = reduce_games_parallel(in.data, in.len, ctx->nthreads);
+        aoc_bench_end(b, 2);
+        ctx->sink += t.cumsum + t.powersum;
+        aoc_input_close(&in);
+        return;
+    }
+
+    aoc_bench_begin(b, 1);
+    GameStore store;
+    Cursor c = {.p = in.data, .end = in.data + in.len};
+    game_store_init(&store);
+    while (scan_game(&c, &store))
+    {
+    }
+    aoc_bench_end(b, 1);
+
+    aoc_bench_begin(b, 2);
+    MinimalSets minimal = minimal_sets_create(&store);
+    GameSet const spec = {.red = NO_OF_RED, .green = NO_OF_GREEN, .blue = NO_OF_BLUE};
+    long cumsum;
+    bag_query_batch(&minimal, &spec, &cumsum, 1);
+    long powersum = 0;
+    for (size_t i = 0; i < minimal.ngames; i++)
+    {
+        powersum += set_power((GameSet) {minimal.red[i], minimal.green[i], minimal.blue[i]});
+    }
+    aoc_bench_end(b, 2);
+
+    ctx->sink += cumsum + powersum;
+    minimal_sets_destroy(&minimal);
+    game_store_destroy(&store);
+    aoc_input_close(&in);
+}
+
+static int bench_main(int argc, char *argv[])
+{
+    struct aoc_bench_config const cfg = aoc_bench_parse_args(argc, argv, MAX_THREADS);
+    char const *const phases[] = {"load", "parse", "solve"};
+    struct bench_ctx ctx = {.fname = cfg.input ? cfg.input : RESULT_FILENAME, .nthreads = cfg.threads, .sink = 0};
+    aoc_bench_run("d2", &cfg, phases, 3, bench_iteration, &ctx);
+    return EXIT_SUCCESS;
+}
+#endif
@@ -4,15 +4,31 @@
 /*
   Build Instructions:
   PATH=../../build/:${PATH}
-  clang -std=c17 -Wall -Wextra aoc-23-d3.c  -g -o ../../build/aoc-23-d3
-  clang -std=c17 -pedantic -Wall -Wextra -g -fsanitize=address aoc-23-d3.c  -o ../../build/aoc-23-d3
+  clang -std=c17 -Wall -Wextra -pthread aoc-23-d3.c aoc-input.c  -g -o ../../build/aoc-23-d3
+  clang -std=c17 -pedantic -Wall -Wextra -pthread -g -fsanitize=address aoc-23-d3.c aoc-input.c  -o ../../build/aoc-23-d3
+  Benchmark build, run with --bench (see aoc-bench.h):
+  clang -std=c17 -Wall -Wextra -pthread -DBENCH aoc-23-d3.c aoc-input.c aoc-bench.c  -O3 -g -o ../../build/aoc-23-d3-bench
+  Instrumented build, counters printed on stderr at exit (see aoc-instr.h):
+  clang -std=c17 -Wall -Wextra -pthread -DAOC_INSTRUMENT aoc-23-d3.c aoc-input.c  -O3 -g -o ../../build/aoc-23-d3-instr
+
+  Usage: aoc-23-d3 [--threads N | --stream] [--packed] [--edits EDITS] [--queries QUERIES] FILENAME
+  With --threads the schematic is cut into N horizontal bands scanned in parallel.
+  FILENAME - reads standard input.
+  With --stream only three rows are kept in memory.
+  With --packed the grid is held at 4 bits per cell and the file is unmapped; no part
+  labels or part lists are kept, the parts around a cell are read back from the grid.
+  With --edits each line "ROW COL CHAR" of EDITS (0 based) overwrites one cell and
+  the sums are updated from the cells around it and reported after every edit.
+  Blank lines are skipped; any other malformed line is an error and no edit is made.
+  With --queries each line "SYMBOLS OP K AGGREGATE" of QUERIES, e.g. "* = 2 product"
+  or "any >= 1 sum", is answered from the symbol adjacency index (see symbol_index).
 
   Program written for the Advent of Code day 3 2023
   First example comes from the problem itself
   "../../data/aoc-23-d3-ex1.txt"
   Next two examples come from https://www.reddit.com/r/adventofcode/comments/189q9wv/2023_day_3_another_sample_grid_to_use/
   "../../Data/aoc-23-d3-ex2.txt" part 1: 413 part 2: 6756
-  "../../data/aoc-23-d3-ex3.txt" part 1: 965 part 2: 6756
+  "../../data/aoc-23-d3-ex3.txt" part 1: 925 part 2: 6756
 
   example2 part I: echo $((12*4 + 34 + 78*2 + 23 + 90 + 2*2 + 56 + 1*2))
   example2 part2: echo $((78 *78 + 12 * 56)) 6756
@@ -23,455 +39,1698 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_COLS 256  /* based on: head -n 1 ../data/aoc-2023-d3.txt | wc | awk '{ print $3 - 1}' */
-#define MAX_ROWS 256  /* Basec on:wc -l ../data/aoc-2023-d3.txt | awk  '{print $1}' */
-#define MAX_DIGITS 8 /* Max digits in the schematic part number */
+#include "aoc-input.h"
+#include "aoc-instr.h"
+#ifdef BENCH
+#include "aoc-bench.h"
+#endif
+
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define MAX_FNAME_LEN 128
+#define MAX_THREADS 256
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS 1 /* the first byte in memory is the low byte of a loaded word */
+#else
+#define SWAR_DIGITS 0
+#endif
 
 /*
-  primary data structure with a single array with all the non newline characters
-  in row major order
+  primary data structure: a read only view of the mapped file in row major order.
+  Rows are stride = ncols + 1 bytes apart so the newlines are skipped, not copied.
 
          0        ncol -1
          ^        ^
-     0 ->|--------|
-         |--------|
-         |--------|
-         |--------|
- nrow-1->|--------|
+     0 ->|--------|\n
+         |--------|\n
+         |--------|\n
+         |--------|\n
+ nrow-1->|--------|\n
             SCHEMATIC
 */
 struct schematic {
-    char *sch;
+    char const *sch;
     int nrows;
     int ncols;
+    int stride;
+    struct aoc_input in; /* the input sch points into */
+    uint8_t *packed; /* NULL, or the cells packed by schematic_pack */
+    struct sparse_cell *other; /* exact characters of the CELL_SYMBOL and CELL_OTHER cells */
+    size_t nother;
+    size_t other_cap;
+};
+
+/*
+  Packed form: two 4 bit codes per byte, cell row * ncols + col in the low nibble of
+  byte cell / 2 when cell is even. Digits keep their value and '.' and '*' have codes
+  of their own; the few remaining symbols and other characters only keep their class
+  in the grid, their characters go to a list sorted by cell.
+ */
+enum cell_code {CELL_DOT = 10, CELL_GEAR = 11, CELL_SYMBOL = 12, CELL_OTHER = 13};
+
+struct sparse_cell {
+    size_t cell;
+    char c;
 };
 
+/* A symbol is any printable character other than a digit, a letter or '.' */
+static bool cell_is_symbol(char const c)
+{
+    return isgraph((unsigned char) c) && !isdigit((unsigned char) c) && !isalpha((unsigned char) c) && c != '.';
+}
+
+static unsigned cell_encode(char const c)
+{
+    if (isdigit((unsigned char) c))
+    {
+        return c - '0';
+    }
+    switch (c)
+    {
+    case '.':
+        return CELL_DOT;
+    case '*':
+        return CELL_GEAR;
+    default:
+        return cell_is_symbol(c) ? CELL_SYMBOL : CELL_OTHER;
+    }
+}
+
+static unsigned schematic_code(struct schematic const * const s, size_t const cell)
+{
+    return (s->packed[cell >> 1] >> ((cell & 1) * 4)) & 0xf;
+}
+
+/* Position of a cell in the sparse list, or of the first entry after it */
+static size_t schematic_other_find(struct schematic const * const s, size_t const cell)
+{
+    size_t lo = 0;
+    size_t hi = s->nother;
+    while (lo < hi)
+    {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (s->other[mid].cell < cell)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static char schematic_packed_get(struct schematic const * const s, size_t const cell)
+{
+    unsigned const code = schematic_code(s, cell);
+    if (code < 10)
+    {
+        return '0' + code;
+    }
+    switch (code)
+    {
+    case CELL_DOT:
+        return '.';
+    case CELL_GEAR:
+        return '*';
+    default:
+        return s->other[schematic_other_find(s, cell)].c;
+    }
+}
+
 static char schematic_get(struct schematic const * const s, int const row,  int const col)
 {
     #ifdef TEST
     assert(row < s->nrows);
     assert(col < s->ncols);
     #endif
-    return s->sch[row * s->ncols + col];
+    if (s->packed)
+    {
+        return schematic_packed_get(s, (size_t) row * s->ncols + col);
+    }
+    return s->sch[(size_t) row * s->stride + col];
 }
 
-static void schematic_put(struct schematic * const s, int const row, int const col, char const c)
+/* Cell tests which read the packed codes directly, without looking up the exact character */
+static bool schematic_is_digit(struct schematic const * const s, int const row, int const col)
 {
-    s->sch[row * s->ncols + col] = c;    
+    if (s->packed)
+    {
+        return schematic_code(s, (size_t) row * s->ncols + col) < 10;
+    }
+    return isdigit((unsigned char) s->sch[(size_t) row * s->stride + col]);
+}
+
+static bool schematic_is_gear(struct schematic const * const s, int const row, int const col)
+{
+    if (s->packed)
+    {
+        return schematic_code(s, (size_t) row * s->ncols + col) == CELL_GEAR;
+    }
+    return s->sch[(size_t) row * s->stride + col] == '*';
+}
+
+static bool schematic_is_symbol(struct schematic const * const s, int const row, int const col)
+{
+    if (s->packed)
+    {
+        unsigned const code = schematic_code(s, (size_t) row * s->ncols + col);
+        return code == CELL_GEAR || code == CELL_SYMBOL;
+    }
+    return cell_is_symbol(s->sch[(size_t) row * s->stride + col]);
+}
+
+/* Helper function for schematic_put: store a cell of the packed form */
+static void schematic_packed_put(struct schematic * const s, size_t const cell, char const c)
+{
+    unsigned const code = cell_encode(c);
+    int const shift = (cell & 1) * 4;
+    s->packed[cell >> 1] = (s->packed[cell >> 1] & ~(0xf << shift)) | (code << shift);
+    size_t const k = schematic_other_find(s, cell);
+    bool const listed = k < s->nother && s->other[k].cell == cell;
+    if (code >= CELL_SYMBOL && listed)
+    {
+        s->other[k].c = c;
+    }
+    else if (code >= CELL_SYMBOL)
+    {
+        if (s->nother == s->other_cap)
+        {
+            s->other_cap = s->other_cap ? 2 * s->other_cap : 64;
+            if (!(s->other = realloc(s->other, sizeof(struct sparse_cell) * s->other_cap)))
+            {
+                fprintf(stderr, "[ERROR:] Memory Error, packed schematic not updated\n");
+                exit(2);
+            }
+        }
+        memmove(s->other + k + 1, s->other + k, sizeof(struct sparse_cell) * (s->nother - k));
+        s->other[k] = (struct sparse_cell) {.cell = cell, .c = c};
+        s->nother++;
+    }
+    else if (listed)
+    {
+        memmove(s->other + k, s->other + k + 1, sizeof(struct sparse_cell) * (s->nother - k - 1));
+        s->nother--;
+    }
 }
-/*
-  A window is a subset of the full schematic
-  It incumbant on the programmer to make sure the window parameters
-  properly overlap the schematic
- */
-struct window {
-    struct schematic const * const s; /* Associated Schematic */
-    /* Location of window within the schematic */
-    int from_row;
-    int to_row;
-    int from_col;
-    int to_col;
-    bool *used; /* array of flags size of the window representing each cell in row major order */
-};
 
-#define window_rows(w) ((w).to_row - (w).from_row + 1) /* no of rows in window */
-#define window_cols(w) ((w).to_col - (w).from_col + 1) /* no of cols in window */
+/* Only for a packed schematic or one created writable: the private copy takes the write, not the file */
+static void schematic_put(struct schematic * const s, int const row,  int const col, char const c)
+{
+    #ifdef TEST
+    assert(row < s->nrows);
+    assert(col < s->ncols);
+    #endif
+    if (s->packed)
+    {
+        schematic_packed_put(s, (size_t) row * s->ncols + col, c);
+        return;
+    }
+    ((char *) s->sch)[(size_t) row * s->stride + col] = c;
+}
 
-/* Part numbers go left to right and have at most MAX_DIGITS - 1 */
+/*
+  Part numbers go left to right. Numbers have no digit limit, so values and the sums
+  and gear ratios built from them are unsigned and wrap modulo 2^64.
+ */
 struct part {
     int beg_col;
     int end_col;
     int row;
-    int value;
-    char partstr[MAX_DIGITS];
+    unsigned long long value;
+    bool valid; /* adjacent to a symbol */
+};
+
+/*
+  A horizontal band of rows. A band owns the parts and the gears of its own rows and
+  only reads the halo rows just above and below it, so every number and every gear
+  is counted by exactly one band.
+ */
+struct band {
+    int from_row;
+    int to_row; /* inclusive */
+    struct part *parts; /* NULL when the part index keeps no labels */
+    int nparts;
+    int cap;
+    unsigned long long partsum; /* of the valid parts, filled in by the labelling pass */
+    unsigned long long gearsum; /* filled in by the gear pass */
+};
+
+/*
+  Part index built by one labelling pass: every digit cell holds the id of the part
+  it belongs to (0 for any other cell) and each part's value is recorded once, in
+  parts[id - 1] of the band owning its row. Questions about the parts around a cell
+  become label lookups.
+  A packed schematic keeps no labels and no part lists, which would take 4 bytes per
+  cell and a record per part against its half byte per cell: the labelling pass only
+  adds up the valid parts, and the parts around a cell are read back from the grid.
+ */
+struct part_index {
+    int *label; /* nrows * ncols labels in row major order, NULL for a packed schematic */
+    struct band *bands;
+    int nbands;
+    int band_rows; /* rows per band, the last band also takes the remainder */
+    int ncols;
+};
+
+/*
+  Symbol to parts adjacency index: every symbol cell is reduced once to the number of
+  distinct parts around it (0 to 8), their sum and their product (1 without parts),
+  and these are added up per (symbol, neighbour count). A query then reads at most
+  256 x 9 aggregates whatever the size of the schematic. Values wrap modulo 2^64.
+ */
+struct symbol_aggregate {
+    unsigned long long count; /* symbol cells */
+    unsigned long long sum; /* of the values of their parts */
+    unsigned long long product; /* sum of the products of their parts */
+};
+
+struct symbol_index {
+    struct symbol_aggregate agg[UCHAR_MAX + 1][9];
+};
+
+/* "SYMBOLS OP K AGGREGATE": the symbol cells of a set with =, >= or <= K parts around them */
+struct symbol_query {
+    bool symbols[UCHAR_MAX + 1];
+    enum {QUERY_EQ, QUERY_GE, QUERY_LE} op;
+    int k;
+    enum {QUERY_COUNT, QUERY_SUM, QUERY_PRODUCT} aggregate;
+    char text[UCHAR_MAX + 32]; /* the query as read, to label the answer */
+};
+
+/* Running totals of the two answers, kept up to date by schematic_edit */
+struct sums {
+    unsigned long long parts;
+    unsigned long long gears;
 };
 
-static struct schematic schematic_create(char const *const fname);
+static struct schematic schematic_create(char const *const fname, bool const writable);
 static void schematic_destroy(struct schematic s);
-static int schematic_scan_and_sum_valid_parts(struct schematic const * const s);
-static int schematic_scan_and_sum_gear_ratios(struct schematic const * const s);
+static void schematic_pack(struct schematic *const s);
+static struct part_index part_index_create(struct schematic const *const s, int const nbands);
+static void part_index_destroy(struct part_index idx);
+static unsigned long long schematic_scan_and_sum_valid_parts(struct part_index const * const idx);
+static unsigned long long schematic_scan_and_sum_gear_ratios(struct schematic const * const s, struct part_index * const idx);
+static void schematic_stream(char const *const fname, unsigned long long *const cumsum, unsigned long long *const gearsum);
+static void schematic_edit(struct schematic *const s, struct part_index *const idx, struct sums *const sums,
+                           int const row, int const col, char const c);
+static void schematic_apply_edits(struct schematic *const s, struct part_index *const idx, struct sums *const sums,
+                                  char const *const fname);
+static struct symbol_index *symbol_index_create(struct schematic const *const s, struct part_index const *const idx);
+static void symbol_index_answer_queries(struct symbol_index const *const si, char const *const fname);
+#ifdef BENCH
+static int bench_main(int argc, char *argv[]);
+#endif
 
 int main(int argc, char *argv[static 1])
 {
-    char fname[MAX_FNAME_LEN];
-    if (argc == 2)
+    char const *fname = NULL;
+    char const *edits = NULL;
+    char const *queries = NULL;
+    int nthreads = 1;
+    bool stream = false;
+    bool packed = false;
+    for (int i = 1; i < argc; i++)
     {
-        strcpy(fname, argv[1]);
+#ifdef BENCH
+        if (!strcmp(argv[i], "--bench"))
+        {
+            return bench_main(argc, argv);
+        }
+#endif
+        if (!strcmp(argv[i], "--stream"))
+        {
+            stream = true;
+        }
+        else if (!strcmp(argv[i], "--packed"))
+        {
+            packed = true;
+        }
+        else if (!strcmp(argv[i], "--queries") && i + 1 < argc)
+        {
+            queries = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--edits") && i + 1 < argc)
+        {
+            edits = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            nthreads = atoi(argv[++i]);
+            if (nthreads < 1 || nthreads > MAX_THREADS)
+            {
+                fprintf(stderr, "[ERROR:] Thread count must be between 1 and %i\n", MAX_THREADS);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!fname)
+        {
+            fname = argv[i];
+        }
+        else
+        {
+            fname = NULL;
+            break;
+        }
     }
-    else
+    if (!fname || (stream && (nthreads > 1 || packed || edits || queries)))
     {
-        fprintf(stderr, "USAGE: %s FILENAME\n", argv[1]);
+        fprintf(stderr, "USAGE: %s [--threads N | --stream] [--packed] [--edits EDITS] [--queries QUERIES] FILENAME\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    struct schematic s = schematic_create(fname);
+    if (stream)
+    {
+        unsigned long long cumsum;
+        unsigned long long gearsum;
+        schematic_stream(fname, &cumsum, &gearsum);
+        printf("The value of the sum of the valid part numbers is: %llu\n", cumsum);
+        printf("The value of the sum of the gear ratios is: %llu\n", gearsum);
+        exit(EXIT_SUCCESS);
+    }
+
+    AOC_PHASE_BEGIN(load);
+    struct schematic s = schematic_create(fname, edits != NULL && !packed);
+    if (packed)
+    {
+        schematic_pack(&s);
+    }
+    AOC_PHASE_END(load);
+    AOC_PHASE_BEGIN(label);
+    struct part_index idx = part_index_create(&s, nthreads);
+    AOC_PHASE_END(label);
 
     /* compute the sum of the values of the valid parts */
-    int const cumsum = schematic_scan_and_sum_valid_parts(&s);
-    printf("The value of the sum of the valid part numbers is: %i\n", cumsum);
+    AOC_PHASE_BEGIN(parts);
+    struct sums sums = {0, 0};
+    sums.parts = schematic_scan_and_sum_valid_parts(&idx);
+    AOC_PHASE_END(parts);
+    printf("The value of the sum of the valid part numbers is: %llu\n", sums.parts);
+
+    AOC_PHASE_BEGIN(gears);
+    sums.gears = schematic_scan_and_sum_gear_ratios(&s, &idx);
+    AOC_PHASE_END(gears);
+    printf("The value of the sum of the gear ratios is: %llu\n", sums.gears);
 
-    int const gearsum = schematic_scan_and_sum_gear_ratios(&s);
-    printf("The value of the sum of the gear ratios is: %i\n", gearsum);
+    if (edits)
+    {
+        AOC_PHASE_BEGIN(edits);
+        schematic_apply_edits(&s, &idx, &sums, edits);
+        AOC_PHASE_END(edits);
+    }
+
+    if (queries) /* about the schematic as edited */
+    {
+        AOC_PHASE_BEGIN(queries);
+        struct symbol_index *si = symbol_index_create(&s, &idx);
+        symbol_index_answer_queries(si, queries);
+        free(si);
+        AOC_PHASE_END(queries);
+    }
 
+    part_index_destroy(idx);
     schematic_destroy(s);
     exit(EXIT_SUCCESS);
 }
 
-/* Helper for schematic create */
-static int schematic_width(char const *const fname)
+/*
+  Helper for schematic create: count the newlines eight bytes at a time. A byte of
+  x = word ^ "\n\n\n\n\n\n\n\n" is zero exactly where the word holds a newline, and
+  the classic zero byte test leaves the top bit set in each such byte.
+ */
+static size_t count_newlines(char const *const data, size_t const len)
 {
-    FILE *f = fopen(fname, "r");
-    char first_line[MAX_ROWS];
-    fscanf(f, "%[^\n]", first_line);
-    fclose(f);
-    return strlen(first_line);
+    uint64_t const ones = 0x0101010101010101ULL;
+    uint64_t const low7 = 0x7f7f7f7f7f7f7f7fULL;
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        uint64_t const x = word ^ (ones * '\n');
+        uint64_t const zero = ~(((x & low7) + low7) | x | low7);
+        count += ((zero >> 7) * ones) >> 56; /* one bit per byte: sum them in the top byte */
+    }
+    for (; i < len; i++)
+    {
+        count += (data[i] == '\n');
+    }
+    return count;
 }
 
-/* Helper for schematic create */
-static int schematic_length(char const *const fname)
+static int ctz64(uint64_t const x)
 {
-    FILE *f = fopen(fname, "r");
-    int row_count = 0;
-    char c;
-    while ((c = fgetc(f)) != EOF)
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!((x >> n) & 1))
     {
-        if (c == '\n')
-        {
-            row_count++;
-        }
+        n++;
     }
-    fclose(f);
-    return row_count;
+    return n;
+#endif
 }
 
 /*
-  Helper for schematic create: it assumes the caller has correctly allocated space for
-  the schematic and that no of cols and no of rows have been computed and set int the
-  schematic struct.
+  SWAR digit handling, eight bytes at a time. A byte is a digit when its high nibble
+  is 3 and its low nibble plus 6 does not carry out of the nibble: both tests leave a
+  zero byte for a digit, which the zero byte test of count_newlines marks.
  */
-static int schematic_fill(struct schematic * const s, char const * const fname)
+static uint64_t digit_bytes(uint64_t const word)
 {
-    FILE *f = fopen(fname, "r");
-    int cur_row = 0;
-    int cur_col = 0;
-    char c;
-    while ((c = fgetc(f)) != EOF)
+    uint64_t const low7 = 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t const x = ((word & 0xf0f0f0f0f0f0f0f0ULL) ^ 0x3030303030303030ULL)
+        | (((word & 0x0f0f0f0f0f0f0f0fULL) + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL);
+    return ~(((x & low7) + low7) | x | low7); /* top bit set in each digit byte */
+}
+
+/* First digit of data at or after i, len if there is none */
+static size_t digit_run_begin(char const *const data, size_t i, size_t const len)
+{
+#if SWAR_DIGITS
+    for (; i + 8 <= len; i += 8)
     {
-        if (c == '\n')
-        {
-            cur_row++;
-            cur_col = 0;
-        }
-        else
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        uint64_t const m = digit_bytes(word);
+        if (m)
         {
-            schematic_put(s, cur_row, cur_col, c);
-            cur_col++;
+            return i + ctz64(m) / 8;
         }
     }
-    fclose(f);
-    return 0;
+#endif
+    while (i < len && !isdigit((unsigned char) data[i]))
+    {
+        i++;
+    }
+    return i;
 }
 
-#ifdef TEST
-/* Helper for schematic create */
-static void schematic_print(struct schematic const * const s)
+/* First byte of data at or after i that is not a digit, len if there is none */
+static size_t digit_run_end(char const *const data, size_t i, size_t const len)
 {
-    for (int i = 0; i < s.nrows; i++)
+#if SWAR_DIGITS
+    for (; i + 8 <= len; i += 8)
     {
-        for (int j = 0; j < ncols; j++)
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        uint64_t const m = ~digit_bytes(word) & 0x8080808080808080ULL;
+        if (m)
         {
-            printf("%c", schematic_get(s->sch, i, j));
+            return i + ctz64(m) / 8;
         }
-        printf("\n");
     }
-}
-#endif
-
-/* Helper for schematic create */
-static struct schematic schematic_create(char const * const fname)
-{
-    struct schematic s;
-    s.nrows = schematic_length(fname);
-    s.ncols = schematic_width(fname);
-    s.sch = malloc(sizeof(char) * s.nrows * s.ncols);
-    schematic_fill(&s, fname);
-#ifdef TEST
-    schematic_print(&sch);
 #endif
-    return s;
-}
-
-static void schematic_destroy(struct schematic s)
-{
-    if (s.sch)
+    while (i < len && isdigit((unsigned char) data[i]))
     {
-        free(s.sch);
+        i++;
     }
+    return i;
 }
 
-/* Helper function for schematic_scan_and_sum_valid_parts */
-static bool is_valid_symbol(char const c)
+/*
+  Eight digits, the most significant first in memory, to their value: neighbouring
+  digits are combined into pairs, pairs into fours and fours into the eight with one
+  multiply-add and mask per step.
+ */
+static uint64_t swar_value8(uint64_t v)
 {
-    return (ispunct(c) && (c != '.')) ? true : false;
+    v -= 0x3030303030303030ULL;
+    v = (v * 10 + (v >> 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v * 100 + (v >> 16)) & 0x0000ffff0000ffffULL;
+    v = (v * 10000 + (v >> 32)) & 0x00000000ffffffffULL;
+    return v;
 }
 
-/* Create a window around a row segment (symbol | part) within the schematic
-   note: end_col IS the index of the last char of the segment not one PAST the last char
-   as is often conventional
+/*
+  Value of the n digits at p, 16 or 8 at a time. A shorter tail is loaded as a whole
+  word when one fits in [lo, hi) on either side of it, the bytes that are not digits
+  of the number being replaced by leading '0's. The result wraps past 2^64.
  */
-static struct window window_create_around_row_seg(struct schematic const *const s, int const row, int const beg_col, int const end_col)
-{
-    struct window w = (struct window) {
-        .s = s, /* Window must be associated with a schematic */
-        /* Location of window within associated schematic */
-        .from_row = MAX(row - 1, 0),
-        .to_row = MIN(row + 1, s->nrows - 1),
-        .from_col = MAX(beg_col - 1, 0),
-        .to_col = MIN(end_col + 1, s->ncols - 1),
-        /* Absolute references to the window */
-        .used = NULL
-    };
-
-    w.used = calloc(window_cols(w) * window_rows(w), sizeof(bool)); /* set to false */    
-    if (!w.used)
+static uint64_t digits_value(char const *p, size_t n, char const *const lo, char const *const hi)
+{
+    uint64_t value = 0;
+#if SWAR_DIGITS
+    static uint64_t const pow10[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+    uint64_t const zeros = 0x3030303030303030ULL;
+    uint64_t word;
+    uint64_t next;
+    for (; n >= 16; p += 16, n -= 16)
     {
-        fprintf(stderr, "[ERROR:] Memory Error, window not created\n");
-        exit(2);
+        memcpy(&word, p, 8);
+        memcpy(&next, p + 8, 8);
+        value = value * (pow10[8] * pow10[8]) + swar_value8(word) * pow10[8] + swar_value8(next);
     }
-
-    /* mark location of segment within window in used array */
-    int const seg_size = end_col - beg_col + 1;
-    int const seg_row = (row == 0) ? 0 : 1;
-    int const seg_beg_col = (beg_col == 0) ? 0 : 1;
-    for (int i = 0; i < seg_size; i++)
+    if (n >= 8)
+    {
+        memcpy(&word, p, 8);
+        value = value * pow10[8] + swar_value8(word);
+        p += 8;
+        n -= 8;
+    }
+    if (n && (size_t) (hi - p) >= 8)
     {
-        w.used[seg_row * window_cols(w) + seg_beg_col + i] = true;
+        memcpy(&word, p, 8); /* the digits are the low n bytes */
+        return value * pow10[n] + swar_value8((word << (64 - 8 * n)) | (zeros >> 8 * n));
     }
-    return w;
+    if (n && (size_t) (p - lo) + n >= 8)
+    {
+        memcpy(&word, p + n - 8, 8); /* the digits are the high n bytes */
+        return value * pow10[n] + swar_value8((word & (~0ULL << (64 - 8 * n))) | (zeros >> 8 * n));
+    }
+#else
+    (void) lo;
+    (void) hi;
+#endif
+    for (; n; n--, p++)
+    {
+        value = value * 10 + (*p - '0');
+    }
+    return value;
 }
 
 #ifdef TEST
-static void window_print(struct window const w, struct schematic const *const s)
+/* Helper for schematic create */
+static void schematic_print(struct schematic const * const s)
 {
-    for( int i = w.from_row; i <= w.to_row; i++)
+    for (int i = 0; i < s.nrows; i++)
     {
-        for (int j = w.from_col; j <= w.to_col; j++)
+        for (int j = 0; j < ncols; j++)
         {
-            printf("%c", schematic_get(s, i, j));
+            printf("%c", schematic_get(s->sch, i, j));
         }
         printf("\n");
     }
 }
 #endif
 
-static void window_destroy(struct window w)
+/*
+  Map the file once: the width is the offset of the first newline and the number of
+  rows the number of newlines (plus an unterminated last row). The grid is used in
+  place, nothing is copied. A writable schematic is a private copy of the input.
+  Trailing blank lines are ignored; any other row of a different width is an error,
+  as the grid is addressed as nrows rows of stride bytes: the length must be nrows
+  strides and every newline must sit at the end of one.
+ */
+static struct schematic schematic_create(char const * const fname, bool const writable)
 {
-    if (w.used) free(w.used);
+    struct schematic s = {
+        .sch = "", .nrows = 0, .ncols = 0, .stride = 1,
+        .in = aoc_input_open(fname, writable ? AOC_INPUT_WRITABLE : 0), .packed = NULL, .other = NULL
+    };
+    char const *const data = s.in.data;
+    size_t len = s.in.len;
+    while (len && data[len - 1] == '\n' && (len == 1 || data[len - 2] == '\n'))
+    {
+        len--; /* a blank last line */
+    }
+    if (len)
+    {
+        s.sch = data;
+        char const *eol = memchr(s.sch, '\n', len);
+        s.ncols = eol ? eol - s.sch : (int) len;
+        s.stride = s.ncols + 1;
+        s.nrows = count_newlines(s.sch, len) + (s.sch[len - 1] != '\n');
+        size_t const expected = (size_t) s.nrows * s.stride - (s.sch[len - 1] != '\n');
+        bool rectangular = (len == expected);
+        for (int r = 0; r < s.nrows - 1 && rectangular; r++)
+        {
+            rectangular = (s.sch[(size_t) (r + 1) * s.stride - 1] == '\n'); /* each row ends where the first did */
+        }
+        if (!rectangular)
+        {
+            fprintf(stderr, "[ERROR:] %s is not a rectangular schematic of %i columns\n", fname, s.ncols);
+            exit(EXIT_FAILURE);
+        }
+    }
+#ifdef TEST
+    schematic_print(&sch);
+#endif
+    return s;
 }
 
-/* Specifiy the location within the schema of the number by giving it's row number and beg and end column number*/
-static bool is_symbol_adjacent(struct schematic const *const s, int const beg_col, int const end_col, int const row)
+static void schematic_destroy(struct schematic s)
 {
-    struct window w = window_create_around_row_seg(s, row, beg_col, end_col);
+    aoc_input_close(&s.in);
+    free(s.packed);
+    free(s.other);
+}
 
-    /* Look for symbol */
-    for (int i = w.from_row; i <= w.to_row; i++)
+/* Convert a mapped schematic to the packed form and drop the mapping */
+static void schematic_pack(struct schematic *const s)
+{
+    size_t const ncells = (size_t) s->nrows * s->ncols;
+    uint8_t *const packed = calloc(ncells / 2 + 1, 1);
+    if (!packed)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, schematic not packed\n");
+        exit(2);
+    }
+    unsigned char code_of[UCHAR_MAX + 1];
+    for (int c = 0; c <= UCHAR_MAX; c++)
+    {
+        code_of[c] = cell_encode((char) c);
+    }
+    struct schematic p = *s;
+    p.packed = packed;
+    size_t cell = 0;
+    for (int i = 0; i < s->nrows; i++)
     {
-        for (int j = w.from_col; j <= w.to_col; j++)
+        unsigned char const *const cells = (unsigned char const *) s->sch + (size_t) i * s->stride;
+        for (int j = 0; j < s->ncols; j++, cell++)
         {
-            char c = schematic_get(s, i,j);
-            if (is_valid_symbol(c))
+            unsigned const code = code_of[cells[j]];
+            packed[cell >> 1] |= code << ((cell & 1) * 4);
+            if (code < CELL_SYMBOL)
             {
-                return true;
+                continue;
+            }
+            if (p.nother == p.other_cap) /* cells arrive in order: the list only grows at its end */
+            {
+                p.other_cap = p.other_cap ? 2 * p.other_cap : 64;
+                if (!(p.other = realloc(p.other, sizeof(struct sparse_cell) * p.other_cap)))
+                {
+                    fprintf(stderr, "[ERROR:] Memory Error, schematic not packed\n");
+                    exit(2);
+                }
             }
+            p.other[p.nother++] = (struct sparse_cell) {.cell = cell, .c = (char) cells[j]};
         }
     }
-    window_destroy(w);
-    return false;
+    AOC_ALLOC("d3 packed grid", ncells / 2 + 1);
+    AOC_COUNT("d3 packed sparse cells", p.nother);
+    s->other = NULL; /* now owned by p */
+    schematic_destroy(*s);
+    p.in = (struct aoc_input) {.data = "", .len = 0, .map_len = 0, .buf = NULL};
+    p.sch = "";
+    p.stride = p.ncols + 1;
+    *s = p;
 }
 
-/* Helper function for schematic_scan_and_sum_valid_parts */
-static int schematic_part_value(struct schematic const *const s, int const beg, int const end, int const row)
+/* Helper function for part_index_create */
+static unsigned long long schematic_part_value(struct schematic const *const s, int const beg, int const end, int const row)
 {
-    char partstr[MAX_DIGITS] = "";
-    int len = 0;
-    for (int i = beg; i <= end; i++)
+    if (!s->packed)
+    {
+        char const *const cells = s->sch + (size_t) row * s->stride;
+        return digits_value(cells + beg, end - beg + 1, s->sch, s->in.data + s->in.len);
+    }
+    unsigned long long part = 0;
+    for (int i = beg; i <= end; i++) /* the packed codes of digits are their values */
     {
-        char c = schematic_get(s, row, i);
-        partstr[len] = c;
-        len++;
+        part = part * 10 + schematic_code(s, (size_t) row * s->ncols + i);
     }
-    partstr[len] = '\0';
     /* To check the sum of these in the output use the following AWK command*/
     /* awk 'BEGIN { FS=OFS=" "; cumsum = 0; } //{ if (NF == 5) cumsum += $5} END {print cumsum}'*/
-    int part = atoi(partstr);
     return part;
 }
 
-static int schematic_scan_and_sum_valid_parts(struct schematic const * const s)
+/*
+  Bit planes of the schematic: bit (col % 64) of word (row * words + col / 64) is set
+  when the cell holds a digit (digit plane) or touches a symbol in any of the 8
+  directions (adjacency plane). A part is valid when its digits meet the adjacency
+  plane, so validity costs a couple of word tests instead of a 3xN rescan.
+ */
+struct planes {
+    uint64_t *digit;
+    uint64_t *adjacent;
+    int words; /* words per row */
+    int from_row; /* schematic row of the first plane row */
+};
+
+/* classify_row on the packed form: the codes alone tell digits and symbols apart */
+static void classify_packed_row(struct schematic const *const s, int const row, uint64_t *const digit, uint64_t *const symbol, int const words)
 {
-    bool digit_found = false; /* are we currently scanning a part nummber? */
-    int beg_part_col = 0;
-    int end_part_col = 0;
-    int cumsum = 0;
-    for (int i = 0; i < s->nrows; i++)
+    size_t const first = (size_t) row * s->ncols;
+    for (int w = 0; w < words; w++)
     {
-        for (int j = 0; j < s->ncols; j++)
+        int const beg = w * 64;
+        int const n = MIN(64, s->ncols - beg);
+        uint64_t d = 0;
+        uint64_t p = 0;
+        for (int k = 0; k < n; k++)
         {
-            char c = schematic_get(s, i, j);
-            if (digit_found)
-            { /* we are scanning a part number */
-                if (isdigit(c) && (j != (s->ncols - 1)))
-                {
-                    end_part_col = j;
-                }
-                else
-                { /* We have completed scanning a part number or end of the line */
-                    if (j == (s->ncols - 1)) /* end of the line*/
-                    {
-                        end_part_col = j;
-                    }
-                    if (is_symbol_adjacent(s, beg_part_col, end_part_col, i))
-                    {
-                        /* Note part number value is 0 if the part number has already been seen */
-                        cumsum += schematic_part_value(s, beg_part_col, end_part_col, i);
-                    }
-                    digit_found = false;
-                    beg_part_col = j; /* reset the beginning digit column */
-                    end_part_col = j; /* reset the end digit column */
-                }                            /* we have completed scanning a part number */
-            }
-            else
-            { /* we are not scanning a part number */
-                if (isdigit(c))
-                {
-                    /* new potential part number */
-                    digit_found = true;
-                    beg_part_col = j;
-                    end_part_col = j;
-                }
-                else
-                {
-                    continue;
-                } /* continue scanning the row for the next part number */
-            }     /* we are not scanning for a part number */
-        }         /* Scan row for part numbers */
-        /* after processing each row do the following: */
-        beg_part_col = 0; /* reset the beginning digit column for the next row */
-        end_part_col = 0; /* reset the end for the next row */
-        digit_found = false;     /* reset the search for a part number for the next row */
-    }                            /* Scan each row for part numbers */
+            unsigned const code = schematic_code(s, first + beg + k);
+            d |= (uint64_t) (code < 10) << k;
+            p |= (uint64_t) (code == CELL_GEAR || code == CELL_SYMBOL) << k;
+        }
+        digit[w] = d;
+        symbol[w] = p;
+    }
+}
 
-    return cumsum;
-} /* End of scan and sum */
+/*
+  Bytes of a word between lo and hi (ASCII, inclusive), the top bit set in each: the
+  low 7 bits of a byte plus 0x80 - lo carry into the top bit when they reach lo, plus
+  0x7f - hi when they pass hi, and bytes with their own top bit set are left out.
+ */
+static uint64_t bytes_between(uint64_t const word, unsigned char const lo, unsigned char const hi)
+{
+    uint64_t const ones = 0x0101010101010101ULL;
+    uint64_t const low7 = word & 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t const ge_lo = low7 + ones * (0x80 - lo);
+    uint64_t const gt_hi = low7 + ones * (0x7f - hi);
+    return ge_lo & ~gt_hi & ~word & 0x8080808080808080ULL;
+}
 
-/* Helper function for schematic_calc_gear_ratio */
-static void update_used(struct window w, struct part const p)
+/* The top bits of the eight bytes of a mask gathered into bits 0 to 7, first byte lowest */
+static unsigned byte_mask_bits(uint64_t const mask)
 {
-    /* find the overlap of the window and the part in the schematic */
-    int const from = MAX(p.beg_col, w.from_col);
-    int const to = MIN(p.end_col, w.to_col);
-    int const size = to - from + 1; /* size of the overlap of part and window */
-    int const offset = MAX(0, p.beg_col - w.from_col); /* where the part begins within the window */
-    int const r = p.row - w.from_row;
-    for (int i = 0; i < size; i++)
-    {
-        int idx = r * window_cols(w) + i + offset;
-        w.used[idx] = true;
-    }
+    return ((mask >> 7) * 0x0102040810204080ULL) >> 56;
 }
 
-/* Helper function for schematic_calc_gear_ratio */
-/* Given there is a digit at schematic_get(s, row, col) return the corresponding part number */
-static struct part schematic_find_part(struct schematic const *const s, int const row, int const col)
+/*
+  Classify one row into packed digit and symbol bits. A symbol is any printable
+  punctuation other than '.', i.e. ispunct in the C locale. Eight cells are tested at
+  a time as byte masks of one word, digit_bytes for the digits and bytes_between for
+  the printable and letter ranges, and each mask is then packed into eight bits; the
+  cells left over at the end of the row are tested one by one.
+ */
+static void classify_row(struct schematic const *const s, int const row, uint64_t *const digit, uint64_t *const symbol, int const words)
 {
-    int const ncols = s->ncols;
-    struct part p;
-    p.row = row;
-    p.beg_col = col;
-    while (isdigit(schematic_get(s, row, col)) && p.beg_col > 0)
+    if (s->packed)
     {
-        p.beg_col--;
+        classify_packed_row(s, row, digit, symbol, words);
+        return;
     }
-    if (!isdigit(schematic_get(s, row, p.beg_col))) p.beg_col++;
-    p.end_col = col;
-    while (isdigit(schematic_get(s, row, p.end_col)) && p.end_col < ncols)
+    char const *const cells = s->sch + (size_t) row * s->stride;
+    for (int w = 0; w < words; w++)
     {
-        p.end_col++;
+        int const beg = w * 64;
+        int const n = MIN(64, s->ncols - beg);
+        uint64_t d = 0;
+        uint64_t p = 0;
+        int k = 0;
+#if SWAR_DIGITS
+        for (; k + 8 <= n; k += 8)
+        {
+            uint64_t word;
+            memcpy(&word, cells + beg + k, 8);
+            uint64_t const is_digit = digit_bytes(word) & 0x8080808080808080ULL;
+            uint64_t const is_alpha = bytes_between(word | 0x2020202020202020ULL, 'a', 'z');
+            uint64_t const is_graph = bytes_between(word, '!', '~');
+            uint64_t const is_dot = bytes_between(word, '.', '.');
+            d |= (uint64_t) byte_mask_bits(is_digit) << k;
+            p |= (uint64_t) byte_mask_bits(is_graph & ~is_digit & ~is_alpha & ~is_dot) << k;
+        }
+#endif
+        for (; k < n; k++)
+        {
+            unsigned char const c = cells[beg + k];
+            unsigned const is_digit = (unsigned char) (c - '0') < 10;
+            unsigned const is_alpha = (unsigned char) ((c | 0x20) - 'a') < 26;
+            unsigned const is_graph = (unsigned char) (c - '!') < 94;
+            unsigned const is_symbol = is_graph & !is_digit & !is_alpha & (c != '.');
+            d |= (uint64_t) is_digit << k;
+            p |= (uint64_t) is_symbol << k;
+        }
+        digit[w] = d;
+        symbol[w] = p;
     }
-    if (!isdigit(schematic_get(s, row, p.end_col))) p.end_col--;
-    int len = 0;
-    for (int i = p.beg_col; i <= p.end_col; i++)
+}
+
+/* Spread the symbol bits of a row one column left and right, carrying across words */
+static void dilate_row(uint64_t const *const symbol, uint64_t *const out, int const words)
+{
+    for (int w = 0; w < words; w++)
     {
-        char c = schematic_get(s, row, i);
-        p.partstr[len] = c;
-        len++;
+        uint64_t const left = (w > 0) ? symbol[w - 1] >> 63 : 0;
+        uint64_t const right = (w + 1 < words) ? symbol[w + 1] << 63 : 0;
+        out[w] = symbol[w] | (symbol[w] << 1) | left | (symbol[w] >> 1) | right;
     }
-    p.partstr[len] = '\0';
-    p.value =atoi(p.partstr);
-    return p;
 }
 
-/* Helper function for schematic_scan_and_sum_gear_ratios*/
-static int schematic_calc_gear_ratio(struct schematic const *const s, int const row, int const col)
+/* Planes of rows from_row..to_row; the symbols of the halo rows around them are read too */
+static struct planes planes_create(struct schematic const *const s, int const from_row, int const to_row)
 {
-    struct window w = window_create_around_row_seg(s, row, col, col);
-    #ifdef TEST    
-    window_print(w, s);
-    #endif
-    struct part part[2]; /* 2 and only 2 parts can be adjacent to the symbol for a valid gear ratio */
-    int n_part = 0;
-
-    /* Look for part numbers overlapping the window */
-    for (int i = w.from_row; i <= w.to_row; i++)
+    int const words = (s->ncols + 63) / 64;
+    size_t const n = (size_t) words * (to_row - from_row + 1);
+    struct planes pl = {
+        .digit = malloc(sizeof(uint64_t) * (n ? n : 1)),
+        .adjacent = calloc(n ? n : 1, sizeof(uint64_t)),
+        .words = words,
+        .from_row = from_row
+    };
+    uint64_t *scratch = malloc(sizeof(uint64_t) * 3 * (words ? words : 1));
+    AOC_ALLOC("d3 bit planes", sizeof(uint64_t) * (2 * (n ? n : 1) + 3 * (words ? words : 1)));
+    if (!pl.digit || !pl.adjacent || !scratch)
     {
-        for (int j = w.from_col; j <= w.to_col; j++)
+        fprintf(stderr, "[ERROR:] Memory Error, bit planes not created\n");
+        exit(2);
+    }
+    uint64_t *const symbol = scratch;
+    uint64_t *const spread = scratch + words;
+    uint64_t *const halo_digit = scratch + 2 * words;
+    for (int i = MAX(from_row - 1, 0); i <= MIN(to_row + 1, s->nrows - 1); i++)
+    {
+        bool const halo = (i < from_row || i > to_row);
+        classify_row(s, i, halo ? halo_digit : pl.digit + (size_t) (i - from_row) * words, symbol, words);
+        dilate_row(symbol, spread, words);
+        /* a symbol reaches its own row and the rows above and below */
+        for (int r = MAX(i - 1, from_row); r <= MIN(i + 1, to_row); r++)
         {
-            int used_idx = (i - w.from_row) * window_cols(w) + (j - w.from_col) ;
-            if (n_part > 1)
+            uint64_t *const adj = pl.adjacent + (size_t) (r - from_row) * words;
+            for (int w = 0; w < words; w++)
             {
-                break;
+                adj[w] |= spread[w];
             }
-            else if (isdigit(schematic_get(s, i, j)) && !w.used[used_idx])
+        }
+    }
+    free(scratch);
+    return pl;
+}
+
+static void planes_destroy(struct planes pl)
+{
+    free(pl.digit);
+    free(pl.adjacent);
+}
+
+/* Index of the first bit at or after col which is set (or clear when set == false) */
+static int plane_find(uint64_t const *const row, int const words, int const col, bool const set)
+{
+    int w = col / 64;
+    if (w >= words)
+    {
+        return words * 64;
+    }
+    uint64_t bits = (set ? row[w] : ~row[w]) & (~UINT64_C(0) << (col % 64));
+    while (!bits)
+    {
+        if (++w == words)
+        {
+            return words * 64;
+        }
+        bits = set ? row[w] : ~row[w];
+    }
+    return w * 64 + ctz64(bits);
+}
+
+/* Is any bit in columns beg..end (inclusive) of the row set? */
+static bool plane_any(uint64_t const *const row, int const beg, int const end)
+{
+    for (int w = beg / 64; w <= end / 64; w++)
+    {
+        int const lo = (w == beg / 64) ? beg % 64 : 0;
+        int const hi = (w == end / 64) ? end % 64 : 63;
+        uint64_t const mask = (~UINT64_C(0) >> (63 - hi)) & (~UINT64_C(0) << lo);
+        if (row[w] & mask)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+  The labelling pass over one band: walk the digit runs of the bit planes once, give
+  each run the next part id of the band, and record its value and whether it touches
+  a symbol. Without labels only the sum of the valid parts is kept.
+ */
+static void band_label(struct schematic const *const s, struct part_index *const idx, struct band *const b)
+{
+    struct planes const pl = planes_create(s, b->from_row, b->to_row);
+    bool const labelled = idx->label != NULL;
+    b->cap = labelled ? 1024 : 0;
+    b->parts = labelled ? malloc(sizeof(struct part) * b->cap) : NULL;
+    b->nparts = 0;
+    b->partsum = 0;
+    AOC_INSTR(unsigned long long nparts = 0;)
+    for (int i = b->from_row; i <= b->to_row && (b->parts || !labelled); i++)
+    {
+        uint64_t const *const digit = pl.digit + (size_t) (i - pl.from_row) * pl.words;
+        uint64_t const *const adjacent = pl.adjacent + (size_t) (i - pl.from_row) * pl.words;
+        int j = plane_find(digit, pl.words, 0, true);
+        while (j < s->ncols) /* each digit run of the row */
+        {
+            int const end = MIN(plane_find(digit, pl.words, j, false), s->ncols) - 1;
+            struct part const p = {
+                .beg_col = j, .end_col = end, .row = i,
+                .value = schematic_part_value(s, j, end, i),
+                .valid = plane_any(adjacent, j, end)
+            };
+            b->partsum += p.valid ? p.value : 0;
+            AOC_INSTR(nparts++;)
+            if (labelled)
             {
-                part[n_part] = schematic_find_part(s, i, j);
-                update_used(w, part[n_part]);
-                n_part++;
+                if (b->nparts == b->cap && !(b->parts = realloc(b->parts, sizeof(struct part) * (b->cap *= 2))))
+                {
+                    break;
+                }
+                b->parts[b->nparts++] = p;
+                for (int k = j; k <= end; k++)
+                {
+                    idx->label[(size_t) i * s->ncols + k] = b->nparts;
+                }
             }
-            else
+            j = plane_find(digit, pl.words, end + 1, true);
+        }
+    }
+    if (labelled && !b->parts)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, part index not created\n");
+        exit(2);
+    }
+    AOC_ALLOC("d3 part lists", sizeof(struct part) * b->cap);
+    AOC_COUNT("d3 parts", nparts);
+    planes_destroy(pl);
+}
+
+/* Work handed to the thread scanning one band */
+struct band_job {
+    struct schematic const *s;
+    struct part_index *idx;
+    struct band *b;
+    void (*scan)(struct schematic const *, struct part_index *, struct band *);
+};
+
+static void *band_job_run(void *arg)
+{
+    struct band_job const *job = arg;
+    job->scan(job->s, job->idx, job->b);
+    return NULL;
+}
+
+/* Run a scan over every band, one thread per band, and wait for all of them */
+static void bands_run(struct schematic const *const s, struct part_index *const idx,
+                      void (*scan)(struct schematic const *, struct part_index *, struct band *))
+{
+    struct band_job jobs[MAX_THREADS];
+    pthread_t tid[MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < idx->nbands; i++)
+    {
+        jobs[i] = (struct band_job) {.s = s, .idx = idx, .b = &idx->bands[i], .scan = scan};
+    }
+    for (; idx->nbands > 1 && started < idx->nbands; started++)
+    {
+        if (pthread_create(&tid[started], NULL, band_job_run, &jobs[started]))
+        {
+            break;
+        }
+    }
+    for (int i = started; i < idx->nbands; i++)
+    {
+        band_job_run(&jobs[i]); /* single band, or could not start a thread */
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tid[i], NULL);
+    }
+}
+
+/* Cut the schematic into bands of whole rows and label every band */
+static struct part_index part_index_create(struct schematic const *const s, int const nbands)
+{
+    size_t const ncells = (size_t) s->nrows * s->ncols;
+    int const n = MAX(MIN(nbands, s->nrows), 1);
+    struct part_index idx = {
+        .label = s->packed ? NULL : calloc(ncells ? ncells : 1, sizeof(int)),
+        .bands = calloc(n, sizeof(struct band)),
+        .nbands = n,
+        .band_rows = MAX(s->nrows / n, 1),
+        .ncols = s->ncols
+    };
+    AOC_ALLOC("d3 part labels", s->packed ? 0 : sizeof(int) * (ncells ? ncells : 1));
+    if ((!s->packed && !idx.label) || !idx.bands)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, part index not created\n");
+        exit(2);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        idx.bands[i].from_row = i * idx.band_rows;
+        idx.bands[i].to_row = (i == n - 1) ? s->nrows - 1 : (i + 1) * idx.band_rows - 1;
+    }
+    bands_run(s, &idx, band_label);
+    return idx;
+}
+
+static void part_index_destroy(struct part_index idx)
+{
+    for (int i = 0; i < idx.nbands; i++)
+    {
+        free(idx.bands[i].parts);
+    }
+    free(idx.bands);
+    free(idx.label);
+}
+
+/* The part covering a cell, NULL if the cell is not a digit; only with labels */
+static struct part const *part_index_get(struct part_index const *const idx, int const row, int const col)
+{
+    int const id = idx->label[(size_t) row * idx->ncols + col];
+    if (!id)
+    {
+        return NULL;
+    }
+    return &idx->bands[MIN(row / idx->band_rows, idx->nbands - 1)].parts[id - 1];
+}
+
+static unsigned long long schematic_scan_and_sum_valid_parts(struct part_index const * const idx)
+{
+    unsigned long long cumsum = 0;
+    for (int i = 0; i < idx->nbands; i++)
+    {
+        cumsum += idx->bands[i].partsum;
+    }
+    return cumsum;
+} /* End of scan and sum */
+
+/* Helper function for neighbour_parts without labels: the digit run through a cell, its validity unknown */
+static struct part schematic_part_at(struct schematic const *const s, int const row, int const col)
+{
+    int beg = col;
+    int end = col;
+    while (beg > 0 && schematic_is_digit(s, row, beg - 1))
+    {
+        beg--;
+    }
+    while (end < s->ncols - 1 && schematic_is_digit(s, row, end + 1))
+    {
+        end++;
+    }
+    return (struct part) {
+        .beg_col = beg, .end_col = end, .row = row, .value = schematic_part_value(s, beg, end, row), .valid = false
+    };
+}
+
+/*
+  Helper function for schematic_scan_and_sum_gear_ratios: collect the distinct parts
+  among the 8 neighbours of a cell; returns how many there are (at most 8). A part is
+  met once per row, at its leftmost digit inside the 3 columns, and is copied from
+  the labels or read back from the grid when there are none.
+ */
+static int neighbour_parts(struct schematic const *const s, struct part_index const *const idx, int const row, int const col, struct part parts[static 8])
+{
+    int n = 0;
+    for (int i = MAX(row - 1, 0); i <= MIN(row + 1, s->nrows - 1); i++)
+    {
+        int const lo = MAX(col - 1, 0);
+        for (int j = lo; j <= MIN(col + 1, s->ncols - 1); j++)
+        {
+            if (!schematic_is_digit(s, i, j) || (j > lo && schematic_is_digit(s, i, j - 1)))
             {
                 continue;
             }
+            parts[n++] = idx->label ? *part_index_get(idx, i, j) : schematic_part_at(s, i, j);
         }
     }
-    window_destroy(w);
-    if (n_part != 1)
+    return n;
+}
+
+/* Helper function for schematic_scan_and_sum_gear_ratios */
+static unsigned long long schematic_calc_gear_ratio(struct schematic const *const s, struct part_index const *const idx, int const row, int const col)
+{
+    struct part parts[8];
+    /* 2 and only 2 parts can be adjacent to the symbol for a valid gear ratio */
+    if (neighbour_parts(s, idx, row, col, parts) != 2)
     {
         return 0;
     }
-   return part[0].value * part[1].value;
+    return parts[0].value * parts[1].value;
 }
 
-static int schematic_scan_and_sum_gear_ratios(struct schematic const * const s)
+/* The gear pass over one band: its own rows, reading the labels of the halo rows */
+static void band_sum_gear_ratios(struct schematic const *const s, struct part_index *const idx, struct band *const b)
 {
-    int cumsum = 0;
-    for (int i = 0; i < s->nrows; i++)
+    b->gearsum = 0;
+    AOC_INSTR(unsigned long long gears = 0;)
+    for (int i = b->from_row; i <= b->to_row; i++)
     {
         for (int j = 0; j < s->ncols; j++)
         {
-            if ('*' == schematic_get(s, i, j))
+            if (schematic_is_gear(s, i, j))
             {
-                cumsum += schematic_calc_gear_ratio(s, i, j);
+                AOC_INSTR(gears++;)
+                b->gearsum += schematic_calc_gear_ratio(s, idx, i, j);
             }
         }
     }
+    AOC_COUNT("d3 gears", gears);
+}
+
+/* Every band must have been labelled: gears on a band edge read the labels of the next band */
+static unsigned long long schematic_scan_and_sum_gear_ratios(struct schematic const * const s, struct part_index * const idx)
+{
+    bands_run(s, idx, band_sum_gear_ratios);
+    unsigned long long cumsum = 0;
+    for (int i = 0; i < idx->nbands; i++)
+    {
+        cumsum += idx->bands[i].gearsum;
+    }
     return cumsum;
 }
+
+/*
+  Incremental update. An edit of cell (row, col) can only change
+  - the digit runs of its row that pass through col - 1 .. col + 1, which may be split
+    or merged: together they span the same columns lo .. hi before and after the edit,
+  - the validity of the parts with a digit in the 3x3 block around the cell,
+  - the gears whose 3x3 block meets one of those runs, i.e. the '*' cells of rows
+    row - 1 .. row + 1 between lo - 1 and hi + 1.
+  Their contributions are taken out, the runs of lo .. hi relabelled and the
+  contributions added back, so the cost follows the length of the runs touched and
+  not the size of the grid.
+ */
+static bool part_touches_symbol(struct schematic const *const s, struct part const *const p)
+{
+    for (int i = MAX(p->row - 1, 0); i <= MIN(p->row + 1, s->nrows - 1); i++)
+    {
+        for (int j = MAX(p->beg_col - 1, 0); j <= MIN(p->end_col + 1, s->ncols - 1); j++)
+        {
+            if (schematic_is_symbol(s, i, j))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Helper function for schematic_edit: the gear ratios of rows row - 1 .. row + 1, columns lo .. hi */
+static unsigned long long schematic_sum_gear_ratios_in(struct schematic const *const s, struct part_index const *const idx,
+                                              int const row, int const lo, int const hi)
+{
+    unsigned long long sum = 0;
+    for (int i = MAX(row - 1, 0); i <= MIN(row + 1, s->nrows - 1); i++)
+    {
+        for (int j = MAX(lo, 0); j <= MIN(hi, s->ncols - 1); j++)
+        {
+            if (schematic_is_gear(s, i, j))
+            {
+                sum += schematic_calc_gear_ratio(s, idx, i, j);
+            }
+        }
+    }
+    return sum;
+}
+
+/* Without labels the validity of a part is not stored: look around it again */
+static bool part_is_valid(struct schematic const *const s, struct part_index const *const idx, struct part const *const p)
+{
+    return idx->label ? p->valid : part_touches_symbol(s, p);
+}
+
+/* Helper function for schematic_edit: the valid values of the parts around a cell */
+static unsigned long long schematic_sum_valid_parts_near(struct schematic const *const s, struct part_index const *const idx,
+                                                int const row, int const col)
+{
+    struct part parts[8];
+    int const n = neighbour_parts(s, idx, row, col, parts);
+    unsigned long long sum = 0;
+    for (int k = 0; k < n; k++)
+    {
+        sum += part_is_valid(s, idx, &parts[k]) ? parts[k].value : 0;
+    }
+    return sum;
+}
+
+/* Relabel the digit runs of row between lo and hi as new parts of the owning band, if there are labels */
+static void part_index_relabel(struct schematic const *const s, struct part_index *const idx,
+                               int const row, int const lo, int const hi)
+{
+    if (!idx->label)
+    {
+        return;
+    }
+    struct band *const b = &idx->bands[MIN(row / idx->band_rows, idx->nbands - 1)];
+    int *const label = idx->label + (size_t) row * s->ncols;
+    for (int j = lo; j <= hi; j++)
+    {
+        if (label[j]) /* the old part is no longer reachable, keep it out of the totals */
+        {
+            b->parts[label[j] - 1].valid = false;
+            label[j] = 0;
+        }
+    }
+    for (int j = lo; j <= hi; j++)
+    {
+        if (!isdigit((unsigned char) schematic_get(s, row, j)))
+        {
+            continue;
+        }
+        int end = j;
+        while (end < hi && isdigit((unsigned char) schematic_get(s, row, end + 1)))
+        {
+            end++;
+        }
+        if (b->nparts == b->cap && !(b->parts = realloc(b->parts, sizeof(struct part) * (b->cap *= 2))))
+        {
+            fprintf(stderr, "[ERROR:] Memory Error, part index not updated\n");
+            exit(2);
+        }
+        struct part *const p = &b->parts[b->nparts++];
+        *p = (struct part) {.beg_col = j, .end_col = end, .row = row, .value = schematic_part_value(s, j, end, row)};
+        p->valid = part_touches_symbol(s, p);
+        for (int k = j; k <= end; k++)
+        {
+            label[k] = b->nparts;
+        }
+        j = end;
+    }
+}
+
+static void schematic_edit(struct schematic *const s, struct part_index *const idx, struct sums *const sums,
+                           int const row, int const col, char const c)
+{
+    AOC_COUNT("d3 edits", 1);
+    int lo = col;
+    int hi = col;
+    while (lo > 0 && isdigit((unsigned char) schematic_get(s, row, lo - 1)))
+    {
+        lo--;
+    }
+    while (hi < s->ncols - 1 && isdigit((unsigned char) schematic_get(s, row, hi + 1)))
+    {
+        hi++;
+    }
+
+    sums->parts -= schematic_sum_valid_parts_near(s, idx, row, col);
+    sums->gears -= schematic_sum_gear_ratios_in(s, idx, row, lo - 1, hi + 1);
+
+    schematic_put(s, row, col, c);
+    part_index_relabel(s, idx, row, lo, hi);
+    struct part parts[8];
+    int const n = neighbour_parts(s, idx, row, col, parts);
+    for (int k = 0; k < n && idx->label; k++)
+    {
+        struct part *const p = (struct part *) part_index_get(idx, parts[k].row, parts[k].beg_col);
+        p->valid = part_touches_symbol(s, p);
+    }
+
+    sums->parts += schematic_sum_valid_parts_near(s, idx, row, col);
+    sums->gears += schematic_sum_gear_ratios_in(s, idx, row, lo - 1, hi + 1);
+}
+
+/* One line "ROW COL CHAR" of an edits file */
+struct cell_edit {
+    int row;
+    int col;
+    char c;
+};
+
+/* Read every edit first, so that a malformed file changes nothing */
+static void schematic_apply_edits(struct schematic *const s, struct part_index *const idx, struct sums *const sums,
+                                  char const *const fname)
+{
+    FILE *fp = fopen(fname, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "[ERROR:] Could not open %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    int n = 0;
+    int cap = 64;
+    struct cell_edit *e = malloc(sizeof(struct cell_edit) * cap);
+    char line[512];
+    for (int lineno = 1; e && fgets(line, sizeof(line), fp); lineno++)
+    {
+        if (!strchr(line, '\n') && !feof(fp))
+        {
+            fprintf(stderr, "[ERROR:] %s:%i: line too long\n", fname, lineno);
+            exit(EXIT_FAILURE);
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line))
+        {
+            continue; /* blank line */
+        }
+        if (n == cap && !(e = realloc(e, sizeof(struct cell_edit) * (cap *= 2))))
+        {
+            break;
+        }
+        char extra;
+        if (sscanf(line, "%i %i %c %c", &e[n].row, &e[n].col, &e[n].c, &extra) != 3)
+        {
+            fprintf(stderr, "[ERROR:] %s:%i: expected \"ROW COL CHAR\", got \"%s\"\n", fname, lineno, line);
+            exit(EXIT_FAILURE);
+        }
+        if (e[n].row < 0 || e[n].row >= s->nrows || e[n].col < 0 || e[n].col >= s->ncols)
+        {
+            fprintf(stderr, "[ERROR:] %s:%i: row %i col %i is outside the schematic\n", fname, lineno, e[n].row, e[n].col);
+            exit(EXIT_FAILURE);
+        }
+        n++;
+    }
+    fclose(fp);
+    if (!e)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, edits not applied\n");
+        exit(2);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        schematic_edit(s, idx, sums, e[i].row, e[i].col, e[i].c);
+        printf("Edit %i, row %i col %i set to '%c': valid parts %llu, gear ratios %llu\n",
+               i + 1, e[i].row, e[i].col, e[i].c, sums->parts, sums->gears);
+    }
+    free(e);
+}
+
+/*
+  Streaming engine: only a ring of three rows (above, middle, below) is held. Once the
+  row below has been read the middle row is final, its parts are checked against the
+  symbols of the three rows and its gears against their numbers, and the window moves
+  down one row. Memory is O(width) whatever the height; rows may have any length and
+  a cell past the end of a row reads as '.'.
+ */
+struct window_row {
+    char *buf;
+    size_t cap;
+    size_t len;
+};
+
+/* Where the rows come from: the lines of the spans handed out by a streaming reader */
+struct window_source {
+    struct aoc_reader reader;
+    struct aoc_lines lines;
+};
+
+static char window_get(struct window_row const *const r, size_t const col)
+{
+    return col < r->len ? r->buf[col] : '.';
+}
+
+/* Copy the next line into a row: the reader's span does not outlive the next refill */
+static bool window_read(struct window_source *const src, struct window_row *const r)
+{
+    char const *line;
+    size_t n;
+    while (!aoc_lines_next(&src->lines, &line, &n))
+    {
+        char const *data;
+        size_t len;
+        if (!aoc_reader_next(&src->reader, &data, &len))
+        {
+            r->len = 0;
+            return false;
+        }
+        src->lines = aoc_lines_of(data, len);
+    }
+    if (n > 0 && line[n - 1] == '\r')
+    {
+        n--;
+    }
+    if (n > r->cap)
+    {
+        AOC_ALLOC("d3 window rows", n);
+        if (!(r->buf = realloc(r->buf, r->cap = n)))
+        {
+            fprintf(stderr, "[ERROR:] Memory Error, window row not grown\n");
+            exit(2);
+        }
+    }
+    if (n)
+    {
+        memcpy(r->buf, line, n); /* an empty row may not have a buffer yet */
+    }
+    r->len = n;
+    return true;
+}
+
+/* The number covering col of a row: walk back to its first digit, then read it */
+static unsigned long long window_number(struct window_row const *const r, size_t col)
+{
+    while (col > 0 && isdigit((unsigned char) window_get(r, col - 1)))
+    {
+        col--;
+    }
+    size_t const end = digit_run_end(r->buf, col, r->len);
+    return digits_value(r->buf + col, end - col, r->buf, r->buf + r->len);
+}
+
+/* Parts and gears of the middle row */
+static void window_emit(struct window_row const win[static 3], unsigned long long *const cumsum, unsigned long long *const gearsum)
+{
+    struct window_row const *const mid = &win[1];
+    for (size_t j = digit_run_begin(mid->buf, 0, mid->len); j < mid->len; j = digit_run_begin(mid->buf, j, mid->len))
+    {
+        size_t const beg = j;
+        j = digit_run_end(mid->buf, j, mid->len);
+        unsigned long long const value = digits_value(mid->buf + beg, j - beg, mid->buf, mid->buf + mid->len);
+        bool valid = false;
+        for (int r = 0; r < 3 && !valid; r++)
+        {
+            for (size_t k = beg ? beg - 1 : 0; k <= j && !valid; k++)
+            {
+                valid = cell_is_symbol(window_get(&win[r], k));
+            }
+        }
+        if (valid)
+        {
+            *cumsum += value;
+        }
+    }
+    for (size_t j = 0; j < mid->len; j++)
+    {
+        if (mid->buf[j] != '*')
+        {
+            continue;
+        }
+        int nparts = 0;
+        unsigned long long ratio = 1;
+        /* a number is met once per row, at its leftmost cell inside the 3 columns */
+        for (int r = 0; r < 3 && nparts <= 2; r++)
+        {
+            size_t const lo = j ? j - 1 : 0;
+            for (size_t k = lo; k <= j + 1; k++)
+            {
+                if (isdigit((unsigned char) window_get(&win[r], k))
+                    && (k == lo || !isdigit((unsigned char) window_get(&win[r], k - 1))))
+                {
+                    if (++nparts <= 2) /* a third part rules the gear out */
+                    {
+                        ratio *= window_number(&win[r], k);
+                    }
+                }
+            }
+        }
+        /* 2 and only 2 parts can be adjacent to the symbol for a valid gear ratio */
+        if (nparts == 2)
+        {
+            *gearsum += ratio;
+        }
+    }
+}
+
+static void schematic_stream(char const *const fname, unsigned long long *const cumsum, unsigned long long *const gearsum)
+{
+    struct window_source src = {.reader = aoc_reader_open(fname), .lines = aoc_lines_of("", 0)};
+    struct window_row win[3] = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}};
+    *cumsum = 0;
+    *gearsum = 0;
+    bool more = window_read(&src, &win[1]);
+    while (more)
+    {
+        more = window_read(&src, &win[2]);
+        window_emit(win, cumsum, gearsum);
+        struct window_row const top = win[0]; /* rotate, reusing the oldest buffer */
+        win[0] = win[1];
+        win[1] = win[2];
+        win[2] = top;
+    }
+    aoc_reader_close(&src.reader);
+    for (int r = 0; r < 3; r++)
+    {
+        free(win[r].buf);
+    }
+}
+
+static struct symbol_index *symbol_index_create(struct schematic const *const s, struct part_index const *const idx)
+{
+    struct symbol_index *si = calloc(1, sizeof(struct symbol_index));
+    if (!si)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, symbol index not created\n");
+        exit(2);
+    }
+    for (int i = 0; i < s->nrows; i++)
+    {
+        for (int j = 0; j < s->ncols; j++)
+        {
+            char const c = schematic_get(s, i, j);
+            if (!cell_is_symbol(c))
+            {
+                continue;
+            }
+            struct part parts[8];
+            int const n = neighbour_parts(s, idx, i, j, parts);
+            unsigned long long sum = 0;
+            unsigned long long product = 1;
+            for (int k = 0; k < n; k++)
+            {
+                sum += parts[k].value;
+                product *= parts[k].value;
+            }
+            struct symbol_aggregate *const a = &si->agg[(unsigned char) c][n];
+            a->count++;
+            a->sum += sum;
+            a->product += product;
+        }
+    }
+    return si;
+}
+
+/* Helper function for symbol_index_answer_queries: parse one query line, false if malformed */
+static bool symbol_query_parse(char const *const line, struct symbol_query *const q)
+{
+    char symbols[UCHAR_MAX + 2];
+    char op[3];
+    char aggregate[16];
+    if (sscanf(line, "%256s %2s %i %15s", symbols, op, &q->k, aggregate) != 4 || q->k < 0 || q->k > 8)
+    {
+        return false;
+    }
+    memset(q->symbols, 0, sizeof(q->symbols));
+    bool const any = !strcmp(symbols, "any");
+    for (int c = 0; c <= UCHAR_MAX; c++)
+    {
+        q->symbols[c] = any && cell_is_symbol((char) c);
+    }
+    for (char const *p = symbols; !any && *p; p++)
+    {
+        q->symbols[(unsigned char) *p] = true;
+    }
+    if (!strcmp(op, "=")) q->op = QUERY_EQ;
+    else if (!strcmp(op, ">=")) q->op = QUERY_GE;
+    else if (!strcmp(op, "<=")) q->op = QUERY_LE;
+    else return false;
+    if (!strcmp(aggregate, "count")) q->aggregate = QUERY_COUNT;
+    else if (!strcmp(aggregate, "sum")) q->aggregate = QUERY_SUM;
+    else if (!strcmp(aggregate, "product")) q->aggregate = QUERY_PRODUCT;
+    else return false;
+    snprintf(q->text, sizeof(q->text), "%s %s %i %s", symbols, op, q->k, aggregate);
+    return true;
+}
+
+/* Answer a batch of queries, each one a walk over the aggregates it selects */
+static void symbol_index_query_batch(struct symbol_index const *const si, struct symbol_query const *const q,
+                                     int const n, unsigned long long *const answer)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int const lo = (q[i].op == QUERY_LE) ? 0 : q[i].k;
+        int const hi = (q[i].op == QUERY_GE) ? 8 : q[i].k;
+        answer[i] = 0;
+        for (int c = 0; c <= UCHAR_MAX; c++)
+        {
+            for (int k = lo; q[i].symbols[c] && k <= hi; k++)
+            {
+                struct symbol_aggregate const *const a = &si->agg[c][k];
+                switch (q[i].aggregate)
+                {
+                case QUERY_COUNT:
+                    answer[i] += a->count;
+                    break;
+                case QUERY_SUM:
+                    answer[i] += a->sum;
+                    break;
+                case QUERY_PRODUCT:
+                    answer[i] += a->product;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void symbol_index_answer_queries(struct symbol_index const *const si, char const *const fname)
+{
+    FILE *fp = fopen(fname, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "[ERROR:] Could not open %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    int n = 0;
+    int cap = 64;
+    struct symbol_query *q = malloc(sizeof(struct symbol_query) * cap);
+    char line[512];
+    while (q && fgets(line, sizeof(line), fp))
+    {
+        if (strspn(line, " \t\r\n") == strlen(line))
+        {
+            continue; /* blank line */
+        }
+        if (n == cap && !(q = realloc(q, sizeof(struct symbol_query) * (cap *= 2))))
+        {
+            break;
+        }
+        if (!symbol_query_parse(line, &q[n]))
+        {
+            fprintf(stderr, "[ERROR:] Malformed query: %s", line);
+            exit(EXIT_FAILURE);
+        }
+        n++;
+    }
+    fclose(fp);
+    unsigned long long *answer = malloc(sizeof(unsigned long long) * (n ? n : 1));
+    if (!q || !answer)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, queries not answered\n");
+        exit(2);
+    }
+    symbol_index_query_batch(si, q, n, answer);
+    for (int i = 0; i < n; i++)
+    {
+        printf("%s: %llu\n", q[i].text, answer[i]);
+    }
+    free(answer);
+    free(q);
+}
+
+#ifdef BENCH
+struct bench_ctx {
+    char const *fname;
+    int nthreads;
+    volatile unsigned long long sink; /* keeps the answers alive */
+};
+
+/* One benchmark iteration: map the schematic, label its parts in bands, sum both answers */
+static void bench_iteration(struct aoc_bench *b, void *arg)
+{
+    struct bench_ctx *ctx = arg;
+    aoc_bench_begin(b, 0);
+    struct schematic s = schematic_create(ctx->fname, false);
+    aoc_bench_end(b, 0);
+    aoc_bench_input_size(b, s.in.len, s.nrows);
+
+    aoc_bench_begin(b, 1);
+    struct part_index idx = part_index_create(&s, ctx->nthreads);
+    aoc_bench_end(b, 1);
+
+    aoc_bench_begin(b, 2);
+    unsigned long long const parts = schematic_scan_and_sum_valid_parts(&idx);
+    unsigned long long const gears = schematic_scan_and_sum_gear_ratios(&s, &idx);
+    aoc_bench_end(b, 2);
+
+    ctx->sink += parts + gears;
+    part_index_destroy(idx);
+    schematic_destroy(s);
+}
+
+static int bench_main(int argc, char *argv[])
+{
+    struct aoc_bench_config const cfg = aoc_bench_parse_args(argc, argv, MAX_THREADS);
+    if (!cfg.input)
+    {
+        fprintf(stderr, "[ERROR:] The benchmark needs a FILENAME\n");
+        exit(EXIT_FAILURE);
+    }
+    char const *const phases[] = {"load", "parse", "solve"};
+    struct bench_ctx ctx = {.fname = cfg.input, .nthreads = cfg.threads, .sink = 0};
+    aoc_bench_run("d3", &cfg, phases, 3, bench_iteration, &ctx);
+    return EXIT_SUCCESS;
+}
+#endif
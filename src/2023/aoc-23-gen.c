@@ -0,0 +1,579 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Build Instructions:
+  PATH=../build/:${PATH}
+  clang -std=c99 -Wall -Wextra aoc-23-gen.c  -O3 -g -o ../build/aoc-23-gen
+
+  Seeded input generator for the 2023 days 1 to 3, for inputs far larger than the
+  puzzle ones (the sizes are only bounded by the disk).
+
+  Usage: aoc-23-gen d1|d2|d3 [--seed S] [OPTIONS] OUTPUT
+  The input is written to OUTPUT and the answers the day should print to
+  OUTPUT.answers, in the day's own words, so a run checks itself with
+      aoc-23-d1 OUTPUT | diff - OUTPUT.answers
+  With OUTPUT "-" the input goes to standard output and the answers to standard
+  error. The same seed and options always give the same bytes.
+
+  d1 options: --lines N (1000), --length L (40, average line length), --words P
+  (30, percent of tokens that are number words), --digits P (10, percent of tokens
+  that are digits), --overlap P (20, percent of number words that are overlapping
+  pairs such as "twone"). Filler letters are taken from "abcdjklmpqyz", which no
+  number word uses, so words only appear where they are placed.
+  d2 options: --games N (100), --sets N (6, most sets per game), --max-count N (20,
+  most cubes of a colour in a set, at most 1000 so the powers fit an int).
+  d3 options: --rows N (140), --cols N (140), --digits P (15, percent of cells
+  starting a number), --symbols P (8, percent of cells holding a symbol), --gears P
+  (40, percent of the symbols that are '*'), --cluster P (20, percent of the gears
+  placed between two numbers, "12*34"), --max-digits N (3, at most 4 so that the
+  gear ratios cannot overflow).
+
+  The answers are computed while the input is written: d1 scans each line for the
+  first and last digit and number word, d2 keeps each game's largest counts, and d3
+  keeps a window of three rows, settling the middle one when the next is known.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define ANSWERS_SUFFIX ".answers"
+#define FILLER "abcdjklmpqyz" /* letters no number word uses */
+#define SYMBOLS "#$%&+-/=@" /* the puzzle symbols besides '*' */
+#define NO_OF_RED 12
+#define NO_OF_GREEN 13
+#define NO_OF_BLUE 14
+#define MAX_COUNT 1000
+#define MAX_DIGITS 4
+
+static char const *const numbers[] = {"one", "two", "three", "four", "five", "six", "seven", "eight", "nine"};
+static char const *const overlaps[] = {"twone", "oneight", "threeight", "fiveight", "nineight", "sevenine", "eightwo", "eighthree"};
+static char const *const colours[] = {"red", "green", "blue"};
+
+/* Generator options, each day reads its own */
+struct options {
+    uint64_t seed;
+    long long lines;
+    int length;
+    int words;
+    int digits;
+    int overlap;
+    long long games;
+    int sets;
+    int max_count;
+    long long rows;
+    int cols;
+    int symbols;
+    int gears;
+    int cluster;
+    int max_digits;
+};
+
+/* splitmix64: one 64 bit state, every seed (0 included) gives a full period stream */
+struct rng {
+    uint64_t state;
+};
+
+static uint64_t rng_next(struct rng *r);
+static int rng_below(struct rng *r, int n);
+static bool rng_percent(struct rng *r, int p);
+static void gen_d1(struct options const *o, FILE *out, FILE *answers);
+static void gen_d2(struct options const *o, FILE *out, FILE *answers);
+static void gen_d3(struct options const *o, FILE *out, FILE *answers);
+
+int main(int argc, char *argv[])
+{
+    struct options o = {
+        .seed = 1, .lines = 1000, .length = 40, .words = 30, .digits = -1, .overlap = 20,
+        .games = 100, .sets = 6, .max_count = 20,
+        .rows = 140, .cols = 140, .symbols = 8, .gears = 40, .cluster = 20, .max_digits = 3
+    };
+    char const *day = NULL;
+    char const *fname = NULL;
+    bool ok = argc > 1;
+    for (int i = 1; i < argc && ok; i++)
+    {
+        char const *const a = argv[i];
+        bool const value = i + 1 < argc;
+        if (!strcmp(a, "--seed") && value)
+        {
+            o.seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(a, "--lines") && value)
+        {
+            o.lines = atoll(argv[++i]);
+        }
+        else if (!strcmp(a, "--length") && value)
+        {
+            o.length = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--words") && value)
+        {
+            o.words = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--digits") && value)
+        {
+            o.digits = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--overlap") && value)
+        {
+            o.overlap = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--games") && value)
+        {
+            o.games = atoll(argv[++i]);
+        }
+        else if (!strcmp(a, "--sets") && value)
+        {
+            o.sets = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--max-count") && value)
+        {
+            o.max_count = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--rows") && value)
+        {
+            o.rows = atoll(argv[++i]);
+        }
+        else if (!strcmp(a, "--cols") && value)
+        {
+            o.cols = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--symbols") && value)
+        {
+            o.symbols = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--gears") && value)
+        {
+            o.gears = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--cluster") && value)
+        {
+            o.cluster = atoi(argv[++i]);
+        }
+        else if (!strcmp(a, "--max-digits") && value)
+        {
+            o.max_digits = atoi(argv[++i]);
+        }
+        else if (!day && (!strcmp(a, "d1") || !strcmp(a, "d2") || !strcmp(a, "d3")))
+        {
+            day = a;
+        }
+        else if (!fname && (a[0] != '-' || !a[1]))
+        {
+            fname = a;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    if (!ok || !day || !fname)
+    {
+        fprintf(stderr, "USAGE: %s d1|d2|d3 [--seed S] [OPTIONS] OUTPUT\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (o.digits < 0) /* the two days have different defaults */
+    {
+        o.digits = (day[1] == '1') ? 10 : 15;
+    }
+    if (o.lines < 0 || o.length < 1 || o.games < 0 || o.sets < 1 || o.rows < 0 || o.cols < 1
+        || o.max_count < 1 || o.max_count > MAX_COUNT || o.max_digits < 1 || o.max_digits > MAX_DIGITS
+        || o.words < 0 || o.digits < 0 || o.words + o.digits > 100 || o.overlap < 0 || o.overlap > 100
+        || o.symbols < 0 || o.digits + o.symbols > 100 || o.gears < 0 || o.gears > 100
+        || o.cluster < 0 || o.cluster > 100)
+    {
+        fprintf(stderr, "[ERROR:] Option out of range, see the usage in aoc-23-gen.c\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool const to_stdout = !strcmp(fname, "-");
+    FILE *out = to_stdout ? stdout : fopen(fname, "w");
+    FILE *answers = stderr;
+    char *answers_fname = NULL;
+    if (!to_stdout)
+    {
+        answers_fname = malloc(strlen(fname) + sizeof(ANSWERS_SUFFIX));
+        if (!answers_fname)
+        {
+            fprintf(stderr, "[ERROR:] Memory Error, answers file not named\n");
+            exit(2);
+        }
+        strcpy(answers_fname, fname);
+        strcat(answers_fname, ANSWERS_SUFFIX);
+        answers = fopen(answers_fname, "w");
+    }
+    if (!out || !answers)
+    {
+        fprintf(stderr, "[ERROR:] Could not create %s\n", !out ? fname : answers_fname);
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    switch (day[1])
+    {
+    case '1':
+        gen_d1(&o, out, answers);
+        break;
+    case '2':
+        gen_d2(&o, out, answers);
+        break;
+    default:
+        gen_d3(&o, out, answers);
+        break;
+    }
+
+    if (fflush(out) || ferror(out) || (!to_stdout && fclose(out)))
+    {
+        fprintf(stderr, "[ERROR:] Could not write %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    if (!to_stdout)
+    {
+        fclose(answers);
+    }
+    free(answers_fname);
+    return EXIT_SUCCESS;
+}
+
+static uint64_t rng_next(struct rng *r)
+{
+    uint64_t z = (r->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, n) for small n: the top bits scaled down, no modulo bias worth noting */
+static int rng_below(struct rng *r, int n)
+{
+    return (int) (((rng_next(r) >> 32) * (uint64_t) n) >> 32);
+}
+
+static bool rng_percent(struct rng *r, int p)
+{
+    return rng_below(r, 100) < p;
+}
+
+static void put_word(char *line, int *len, char const *w)
+{
+    size_t const n = strlen(w);
+    memcpy(line + *len, w, n);
+    *len += n;
+}
+
+/* Helper function for gen_d1: value of the number word or digit starting at p, 0 if none */
+static int d1_value_at(char const *p, char const *end, bool words)
+{
+    if (*p >= '1' && *p <= '9')
+    {
+        return *p - '0';
+    }
+    if (!words)
+    {
+        return 0;
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        size_t const n = strlen(numbers[i]);
+        if ((size_t) (end - p) >= n && !memcmp(p, numbers[i], n))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/* Helper function for gen_d1: the calibration value of a line, first and last match */
+static int d1_calibration(char const *line, int len, bool words)
+{
+    int first = 0;
+    int last = 0;
+    for (int i = 0; i < len; i++)
+    {
+        int const v = d1_value_at(line + i, line + len, words);
+        if (v)
+        {
+            first = first ? first : v;
+            last = v;
+        }
+    }
+    return first * 10 + last;
+}
+
+/*
+  Each line is a sequence of tokens: filler runs, digits, number words and
+  overlapping pairs, until it reaches its length drawn around the average. A line
+  gets a digit at its end if none was drawn, as every puzzle line has one.
+ */
+static void gen_d1(struct options const *o, FILE *out, FILE *answers)
+{
+    struct rng r = {o->seed};
+    int const max_len = 2 * o->length + 16;
+    char *line = malloc(max_len + 1);
+    if (!line)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, line not allocated\n");
+        exit(2);
+    }
+    long digits_sum = 0;
+    long words_sum = 0;
+    for (long long n = 0; n < o->lines; n++)
+    {
+        int const target = 1 + rng_below(&r, 2 * o->length);
+        int len = 0;
+        bool digit = false;
+        while (len < target)
+        {
+            int const roll = rng_below(&r, 100);
+            if (roll < o->digits)
+            {
+                line[len++] = '1' + rng_below(&r, 9);
+                digit = true;
+            }
+            else if (roll < o->digits + o->words)
+            {
+                int const k = sizeof(overlaps) / sizeof(overlaps[0]);
+                put_word(line, &len, rng_percent(&r, o->overlap) ? overlaps[rng_below(&r, k)] : numbers[rng_below(&r, 9)]);
+            }
+            else
+            {
+                line[len++] = FILLER[rng_below(&r, sizeof(FILLER) - 1)];
+            }
+        }
+        if (!digit)
+        {
+            line[len++] = '1' + rng_below(&r, 9);
+        }
+        digits_sum += d1_calibration(line, len, false);
+        words_sum += d1_calibration(line, len, true);
+        line[len++] = '\n';
+        fwrite(line, 1, len, out);
+    }
+    free(line);
+    fprintf(answers, "The sum of the numerals only is %li\n", digits_sum);
+    fprintf(answers, "The sum is %li\n", words_sum);
+}
+
+/* Each set draws a non empty subset of the colours, in a random order */
+static void gen_d2(struct options const *o, FILE *out, FILE *answers)
+{
+    struct rng r = {o->seed};
+    long cumsum = 0;
+    long powersum = 0;
+    for (long long id = 1; id <= o->games; id++)
+    {
+        int max[3] = {0, 0, 0};
+        int const nsets = 1 + rng_below(&r, o->sets);
+        fprintf(out, "Game %lli:", id);
+        for (int s = 0; s < nsets; s++)
+        {
+            int order[3] = {0, 1, 2};
+            for (int i = 2; i > 0; i--) /* Fisher-Yates */
+            {
+                int const j = rng_below(&r, i + 1);
+                int const t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+            int const ncolours = 1 + rng_below(&r, 3);
+            for (int i = 0; i < ncolours; i++)
+            {
+                int const count = 1 + rng_below(&r, o->max_count);
+                max[order[i]] = count > max[order[i]] ? count : max[order[i]];
+                fprintf(out, "%s %i %s", i ? "," : "", count, colours[order[i]]);
+            }
+            fputs(s + 1 < nsets ? ";" : "\n", out);
+        }
+        if (max[0] <= NO_OF_RED && max[1] <= NO_OF_GREEN && max[2] <= NO_OF_BLUE)
+        {
+            cumsum += id;
+        }
+        powersum += (long) max[0] * max[1] * max[2];
+    }
+    fprintf(answers, "The sum of the possible game ids is: %li\n", cumsum);
+    fprintf(answers, "The cumulative power of the minimal games is %li\n", powersum);
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool is_symbol(char c)
+{
+    return c != '.' && !is_digit(c);
+}
+
+/* Helper function for gen_d3: draw one row, numbers never touching each other */
+static void d3_row(struct options const *o, struct rng *r, char *row)
+{
+    int const cols = o->cols;
+    int c = 0;
+    while (c < cols)
+    {
+        int const roll = rng_below(r, 100);
+        bool const after_digit = c > 0 && is_digit(row[c - 1]);
+        if (roll < o->digits && !after_digit)
+        {
+            int const n = 1 + rng_below(r, o->max_digits);
+            for (int i = 0; i < n && c < cols; i++)
+            {
+                row[c++] = (i == 0 && n > 1) ? '1' + rng_below(r, 9) : '0' + rng_below(r, 10);
+            }
+        }
+        else if (roll < o->digits + o->symbols)
+        {
+            bool const gear = rng_percent(r, o->gears);
+            if (gear && !after_digit && rng_percent(r, o->cluster) && c + 2 < cols)
+            {
+                /* a number on each side: "N*N", the numbers as long as the row allows */
+                int const left = 1 + rng_below(r, o->max_digits);
+                for (int i = 0; i < left && c < cols - 2; i++)
+                {
+                    row[c++] = '1' + rng_below(r, 9);
+                }
+                row[c++] = '*';
+                int const right = 1 + rng_below(r, o->max_digits);
+                for (int i = 0; i < right && c < cols; i++)
+                {
+                    row[c++] = '1' + rng_below(r, 9);
+                }
+            }
+            else
+            {
+                row[c++] = gear ? '*' : SYMBOLS[rng_below(r, sizeof(SYMBOLS) - 1)];
+            }
+        }
+        else
+        {
+            row[c++] = '.';
+        }
+    }
+}
+
+/* Helper function for gen_d3: the number whose digits include row[c] */
+static long long d3_number(char const *row, int c)
+{
+    while (c > 0 && is_digit(row[c - 1]))
+    {
+        c--;
+    }
+    long long v = 0;
+    for (; is_digit(row[c]); c++)
+    {
+        v = v * 10 + (row[c] - '0');
+    }
+    return v;
+}
+
+/*
+  Helper function for gen_d3: the numbers of one row next to column c, at most two
+  since a number under c covers both c - 1 and c + 1. Returns how many were found.
+ */
+static int d3_numbers_near(char const *row, int cols, int c, long long value[2])
+{
+    if (!row)
+    {
+        return 0;
+    }
+    if (is_digit(row[c]))
+    {
+        value[0] = d3_number(row, c);
+        return 1;
+    }
+    int n = 0;
+    if (c > 0 && is_digit(row[c - 1]))
+    {
+        value[n++] = d3_number(row, c - 1);
+    }
+    if (c + 1 < cols && is_digit(row[c + 1]))
+    {
+        value[n++] = d3_number(row, c + 1);
+    }
+    return n;
+}
+
+/* Helper function for gen_d3: settle row cur, rows above and below may be NULL */
+static void d3_settle(char const *above, char const *cur, char const *below, int cols,
+                      long long *cumsum, long long *gearsum)
+{
+    char const *const rows[3] = {above, cur, below};
+    for (int c = 0; c < cols; c++)
+    {
+        if (is_digit(cur[c]) && (c == 0 || !is_digit(cur[c - 1])))
+        {
+            int end = c;
+            while (end < cols && is_digit(cur[end]))
+            {
+                end++;
+            }
+            bool valid = false;
+            for (int k = 0; k < 3 && !valid; k++)
+            {
+                for (int x = (c > 0 ? c - 1 : 0); rows[k] && x <= end && x < cols && !valid; x++)
+                {
+                    valid = is_symbol(rows[k][x]);
+                }
+            }
+            if (valid)
+            {
+                *cumsum += d3_number(cur, c);
+            }
+        }
+        else if (cur[c] == '*')
+        {
+            long long value[6];
+            int n = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                n += d3_numbers_near(rows[k], cols, c, value + n);
+            }
+            if (n == 2)
+            {
+                *gearsum += value[0] * value[1];
+            }
+        }
+    }
+}
+
+/* Rows are drawn one ahead of the row being settled, three are kept at any time */
+static void gen_d3(struct options const *o, FILE *out, FILE *answers)
+{
+    struct rng r = {o->seed};
+    int const cols = o->cols;
+    char *buf = malloc(3 * ((size_t) cols + 1));
+    if (!buf)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, rows not allocated\n");
+        exit(2);
+    }
+    char *window[3] = {buf, buf + cols + 1, buf + 2 * ((size_t) cols + 1)};
+    long long cumsum = 0;
+    long long gearsum = 0;
+    for (long long n = 0; n <= o->rows; n++)
+    {
+        char *const next = (n < o->rows) ? window[2] : NULL;
+        if (next)
+        {
+            d3_row(o, &r, next);
+            next[cols] = '\n';
+            fwrite(next, 1, cols + 1, out);
+        }
+        if (n > 0) /* the row before next is complete with both neighbours */
+        {
+            d3_settle(n > 1 ? window[0] : NULL, window[1], next, cols, &cumsum, &gearsum);
+        }
+        char *const t = window[0];
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = t;
+    }
+    free(buf);
+    fprintf(answers, "The value of the sum of the valid part numbers is: %lli\n", cumsum);
+    fprintf(answers, "The value of the sum of the gear ratios is: %lli\n", gearsum);
+}
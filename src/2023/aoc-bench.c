@@ -0,0 +1,373 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Benchmark harness shared by the 2023 solutions, see aoc-bench.h
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* syscall */
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#else
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aoc-bench.h"
+
+#define NCOUNTERS 4
+#define MAX_ITERATIONS 100000
+
+static char const *const counter_names[NCOUNTERS] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+/*
+  Samples are stored per phase, the total of each iteration being one more phase after
+  the day's own: ns[phase * iterations + i] and counts[(phase * NCOUNTERS + c) * iterations + i].
+ */
+struct aoc_bench {
+    char const *const *phases;
+    int nphases;
+    int iterations;
+    int current; /* iteration being recorded, -1 during the warm-up */
+    double *ns;
+    long long *counts;
+    struct timespec start[AOC_BENCH_MAX_PHASES];
+    long long counter_start[AOC_BENCH_MAX_PHASES][NCOUNTERS];
+    int fd[NCOUNTERS]; /* -1 for a counter the kernel did not give us */
+    size_t bytes;
+    size_t lines;
+};
+
+/* Open the hardware counters of this process, its future threads included */
+static void counters_open(struct aoc_bench *b)
+{
+#if defined(__linux__)
+    static uint64_t const config[NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[c];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        b->fd[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (b->fd[c] >= 0)
+        {
+            ioctl(b->fd[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        b->fd[c] = -1;
+    }
+#endif
+}
+
+static void counters_read(struct aoc_bench const *b, long long value[NCOUNTERS])
+{
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        uint64_t v = 0;
+        value[c] = (b->fd[c] >= 0 && read(b->fd[c], &v, sizeof(v)) == sizeof(v)) ? (long long) v : -1;
+    }
+}
+
+/* The total of an iteration is the sum of its phases, the untimed work between them is left out */
+static void total_record(struct aoc_bench *b)
+{
+    size_t const i = b->current;
+    size_t const n = b->iterations;
+    double ns = 0;
+    long long counts[NCOUNTERS] = {0};
+    for (int phase = 0; phase < b->nphases; phase++)
+    {
+        ns += b->ns[phase * n + i];
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            long long const v = b->counts[(phase * NCOUNTERS + c) * n + i];
+            counts[c] = (v < 0 || counts[c] < 0) ? -1 : counts[c] + v;
+        }
+    }
+    b->ns[b->nphases * n + i] = ns;
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        b->counts[(b->nphases * NCOUNTERS + c) * n + i] = counts[c];
+    }
+}
+
+static double elapsed_ns(struct timespec const *from, struct timespec const *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e9 + (to->tv_nsec - from->tv_nsec);
+}
+
+void aoc_bench_begin(struct aoc_bench *b, int phase)
+{
+    counters_read(b, b->counter_start[phase]);
+    clock_gettime(CLOCK_MONOTONIC, &b->start[phase]);
+}
+
+void aoc_bench_end(struct aoc_bench *b, int phase)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long value[NCOUNTERS];
+    counters_read(b, value);
+    if (b->current < 0)
+    {
+        return; /* warming up */
+    }
+    b->ns[(size_t) phase * b->iterations + b->current] = elapsed_ns(&b->start[phase], &now);
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        long long const start = b->counter_start[phase][c];
+        b->counts[((size_t) phase * NCOUNTERS + c) * b->iterations + b->current] =
+            (value[c] < 0 || start < 0) ? -1 : value[c] - start;
+    }
+}
+
+void aoc_bench_input_size(struct aoc_bench *b, size_t bytes, size_t lines)
+{
+    b->bytes = bytes;
+    b->lines = lines;
+}
+
+size_t aoc_bench_count_lines(char const *data, size_t len)
+{
+    size_t lines = 0;
+    for (char const *p = data, *end = data + len; p < end; lines++)
+    {
+        char const *eol = memchr(p, '\n', end - p);
+        p = eol ? eol + 1 : end;
+    }
+    return lines;
+}
+
+/* max_threads is the most the day can run, its thread arrays are fixed in size */
+struct aoc_bench_config aoc_bench_parse_args(int argc, char *argv[], int max_threads)
+{
+    struct aoc_bench_config cfg = {.input = NULL, .iterations = 20, .warmup = 3, .threads = 1, .format = AOC_BENCH_TEXT};
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--bench"))
+        {
+            continue; /* the switch that got us here */
+        }
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+        {
+            cfg.iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+        {
+            cfg.warmup = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            cfg.threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            i++;
+            cfg.format = !strcmp(argv[i], "csv") ? AOC_BENCH_CSV : !strcmp(argv[i], "json") ? AOC_BENCH_JSON : AOC_BENCH_TEXT;
+        }
+        else if (argv[i][0] != '-' || !argv[i][1])
+        {
+            cfg.input = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "USAGE: %s --bench [--iterations N] [--warmup N] [--threads N] [--format text|csv|json] [FILENAME]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (cfg.iterations < 1 || cfg.iterations > MAX_ITERATIONS || cfg.warmup < 0)
+    {
+        fprintf(stderr, "[ERROR:] Iterations must be between 1 and %i, warm-up positive\n", MAX_ITERATIONS);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.threads < 1 || cfg.threads > max_threads)
+    {
+        fprintf(stderr, "[ERROR:] Thread count must be between 1 and %i\n", max_threads);
+        exit(EXIT_FAILURE);
+    }
+    return cfg;
+}
+
+static int compare_double(void const *a, void const *b)
+{
+    double const x = *(double const *) a;
+    double const y = *(double const *) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_long_long(void const *a, void const *b)
+{
+    long long const x = *(long long const *) a;
+    long long const y = *(long long const *) b;
+    return (x > y) - (x < y);
+}
+
+/* Median and 99th percentile (nearest rank) of n samples, sorted in place */
+static void percentiles(double *v, int n, double *median, double *p99)
+{
+    qsort(v, n, sizeof(double), compare_double);
+    *median = (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    int const rank = (99 * n + 99) / 100; /* ceil(0.99 n) */
+    *p99 = v[rank - 1];
+}
+
+static long long median_count(long long *v, int n)
+{
+    qsort(v, n, sizeof(long long), compare_long_long);
+    return v[0] < 0 ? -1 : v[n / 2];
+}
+
+static void report(char const *day, struct aoc_bench *b, enum aoc_bench_format format)
+{
+    if (format == AOC_BENCH_CSV)
+    {
+        printf("day,phase,iterations,median_ns,p99_ns,bytes_per_s,lines_per_s");
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            printf(",%s", counter_names[c]);
+        }
+        printf("\n");
+    }
+    else if (format == AOC_BENCH_JSON)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("%-6s %-8s %12s %12s %12s %12s %14s %14s %12s %12s\n", "day", "phase", "median ms", "p99 ms",
+               "MB/s", "Mlines/s", counter_names[0], counter_names[1], counter_names[2], counter_names[3]);
+    }
+    for (int phase = 0; phase <= b->nphases; phase++)
+    {
+        char const *const name = (phase < b->nphases) ? b->phases[phase] : "total";
+        double median;
+        double p99;
+        percentiles(b->ns + (size_t) phase * b->iterations, b->iterations, &median, &p99);
+        double const seconds = median > 0 ? median / 1e9 : 1e-9;
+        long long counts[NCOUNTERS];
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            counts[c] = median_count(b->counts + ((size_t) phase * NCOUNTERS + c) * b->iterations, b->iterations);
+        }
+        switch (format)
+        {
+        case AOC_BENCH_CSV:
+            printf("%s,%s,%i,%.0f,%.0f,%.0f,%.0f", day, name, b->iterations, median, p99,
+                   b->bytes / seconds, b->lines / seconds);
+            for (int c = 0; c < NCOUNTERS; c++)
+            {
+                if (counts[c] < 0)
+                {
+                    printf(",");
+                }
+                else
+                {
+                    printf(",%lli", counts[c]);
+                }
+            }
+            printf("\n");
+            break;
+        case AOC_BENCH_JSON:
+            printf("  {\"day\": \"%s\", \"phase\": \"%s\", \"iterations\": %i, \"median_ns\": %.0f, \"p99_ns\": %.0f, "
+                   "\"bytes_per_s\": %.0f, \"lines_per_s\": %.0f", day, name, b->iterations, median, p99,
+                   b->bytes / seconds, b->lines / seconds);
+            for (int c = 0; c < NCOUNTERS; c++)
+            {
+                if (counts[c] < 0)
+                {
+                    printf(", \"%s\": null", counter_names[c]);
+                }
+                else
+                {
+                    printf(", \"%s\": %lli", counter_names[c], counts[c]);
+                }
+            }
+            printf("}%s\n", phase < b->nphases ? "," : "");
+            break;
+        case AOC_BENCH_TEXT:
+            printf("%-6s %-8s %12.3f %12.3f %12.1f %12.3f", day, name, median / 1e6, p99 / 1e6,
+                   b->bytes / seconds / 1e6, b->lines / seconds / 1e6);
+            for (int c = 0; c < NCOUNTERS; c++)
+            {
+                int const width = c < 2 ? 14 : 12;
+                if (counts[c] < 0)
+                {
+                    printf(" %*s", width, "NA");
+                }
+                else
+                {
+                    printf(" %*lli", width, counts[c]);
+                }
+            }
+            printf("\n");
+            break;
+        }
+    }
+    if (format == AOC_BENCH_JSON)
+    {
+        printf("]\n");
+    }
+}
+
+void aoc_bench_run(char const *day, struct aoc_bench_config const *cfg, char const *const phases[], int nphases,
+                   aoc_bench_fn iteration, void *ctx)
+{
+    if (nphases > AOC_BENCH_MAX_PHASES)
+    {
+        fprintf(stderr, "[ERROR:] At most %i phases can be timed\n", AOC_BENCH_MAX_PHASES);
+        exit(EXIT_FAILURE);
+    }
+    struct aoc_bench b = {
+        .phases = phases,
+        .nphases = nphases,
+        .iterations = cfg->iterations,
+        .current = -1,
+        .ns = calloc((size_t) (nphases + 1) * cfg->iterations, sizeof(double)),
+        .counts = calloc((size_t) (nphases + 1) * NCOUNTERS * cfg->iterations, sizeof(long long)),
+        .bytes = 0,
+        .lines = 0
+    };
+    if (!b.ns || !b.counts)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, benchmark samples not allocated\n");
+        exit(2);
+    }
+    counters_open(&b);
+    for (int i = -cfg->warmup; i < cfg->iterations; i++)
+    {
+        b.current = i < 0 ? -1 : i;
+        iteration(&b, ctx);
+        if (b.current >= 0)
+        {
+            total_record(&b);
+        }
+    }
+    report(day, &b, cfg->format);
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        if (b.fd[c] >= 0)
+        {
+            close(b.fd[c]);
+        }
+    }
+    free(b.ns);
+    free(b.counts);
+}
@@ -0,0 +1,49 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Benchmark harness shared by the 2023 solutions. A day built with -DBENCH and linked
+  with aoc-bench.c runs its phases repeatedly when given --bench, e.g.
+  clang -std=c99 -Wall -Wextra -pthread -DBENCH aoc-23-d1.c aoc-input.c aoc-bench.c  -O3 -g -o ../build/aoc-23-d1-bench
+  aoc-23-d1-bench --bench [--iterations N] [--warmup N] [--threads N] [--format text|csv|json] [FILENAME] > bench_output.txt
+
+  Each iteration calls the day's function, which wraps its phases (load, parse,
+  solve) in aoc_bench_begin/aoc_bench_end and does any bookkeeping, such as
+  aoc_bench_count_lines or freeing, outside them. After the warm-up iterations the
+  wall time of every phase is recorded, the total being their sum, and the report gives
+  the median and the 99th percentile with the bytes and lines per second of the
+  median. On Linux the cycles, instructions, cache misses and branch misses of each
+  phase are read through perf_event_open, threads included; where the kernel refuses
+  the counters they are reported as missing.
+ */
+
+#ifndef AOC_BENCH_H
+#define AOC_BENCH_H
+
+#include <stddef.h>
+
+#define AOC_BENCH_MAX_PHASES 8
+
+enum aoc_bench_format {AOC_BENCH_TEXT, AOC_BENCH_CSV, AOC_BENCH_JSON};
+
+struct aoc_bench_config {
+    char const *input; /* NULL unless given on the command line */
+    int iterations;
+    int warmup;
+    int threads;
+    enum aoc_bench_format format;
+};
+
+struct aoc_bench;
+
+typedef void (*aoc_bench_fn)(struct aoc_bench *b, void *ctx);
+
+struct aoc_bench_config aoc_bench_parse_args(int argc, char *argv[], int max_threads);
+void aoc_bench_run(char const *day, struct aoc_bench_config const *cfg, char const *const phases[], int nphases,
+                   aoc_bench_fn iteration, void *ctx);
+void aoc_bench_begin(struct aoc_bench *b, int phase);
+void aoc_bench_end(struct aoc_bench *b, int phase);
+void aoc_bench_input_size(struct aoc_bench *b, size_t bytes, size_t lines);
+size_t aoc_bench_count_lines(char const *data, size_t len);
+
+#endif /* AOC_BENCH_H */
@@ -0,0 +1,457 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Input layer shared by the 2023 solutions, see aoc-input.h
+ */
+
+#define _POSIX_C_SOURCE 200809L /* mmap, posix_madvise */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aoc-input.h"
+#include "aoc-instr.h"
+
+#define READ_BLOCK (1 << 20) /* bytes asked for by each read of a pipe */
+#define READER_BUFFER_SIZE (1 << 16) /* initial buffer of a streaming reader */
+#define READ_AHEAD_BLOCK (1 << 22) /* bytes read into each buffer of the read-ahead ring */
+#define READ_AHEAD_SPARE 2 /* buffers in the ring besides one per worker */
+#define MAX_WORKERS 256
+
+static int input_fd(char const *fname)
+{
+    int fd = strcmp(fname, "-") ? open(fname, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0)
+    {
+        fprintf(stderr, "[ERROR:] Could not open %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+/* Read fd to the end in large blocks, growing the buffer as needed */
+static void input_read(struct aoc_input *in, int fd, char const *fname)
+{
+    size_t cap = READ_BLOCK;
+    char *buf = malloc(cap);
+    size_t len = 0;
+    while (buf)
+    {
+        if (cap - len < READ_BLOCK)
+        {
+            AOC_ALLOC("input read growth", cap * 2);
+            if (!(buf = realloc(buf, cap *= 2)))
+            {
+                break;
+            }
+        }
+        ssize_t const n = read(fd, buf + len, cap - len);
+        if (n <= 0)
+        {
+            break;
+        }
+        len += n;
+    }
+    if (!buf)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, %s not read\n", fname);
+        exit(2);
+    }
+    in->buf = buf;
+    in->data = buf;
+    in->len = len;
+}
+
+/* Map a regular file, read anything else; an empty input gives an empty span */
+struct aoc_input aoc_input_open(char const *fname, int flags)
+{
+    struct aoc_input in = {.data = "", .len = 0, .map_len = 0, .buf = NULL};
+    int const fd = input_fd(fname);
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "[ERROR:] Could not open %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        int const prot = PROT_READ | ((flags & AOC_INPUT_WRITABLE) ? PROT_WRITE : 0);
+        void *map = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+            AOC_COUNT("input mapped bytes", st.st_size);
+            in.data = map;
+            in.len = in.map_len = st.st_size;
+        }
+    }
+    if (!in.map_len) /* a pipe, a terminal, or a file that could not be mapped */
+    {
+        input_read(&in, fd, fname);
+    }
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return in;
+}
+
+void aoc_input_close(struct aoc_input *in)
+{
+    if (in->map_len)
+    {
+        munmap((void *) in->data, in->map_len);
+    }
+    free(in->buf);
+    in->data = "";
+    in->len = in->map_len = 0;
+    in->buf = NULL;
+}
+
+struct aoc_reader aoc_reader_open(char const *fname)
+{
+    struct aoc_reader r = {
+        .fd = input_fd(fname),
+        .buf = malloc(READER_BUFFER_SIZE),
+        .cap = READER_BUFFER_SIZE,
+        .len = 0,
+        .used = 0,
+        .eof = false
+    };
+    if (!r.buf)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, %s not read\n", fname);
+        exit(2);
+    }
+    return r;
+}
+
+bool aoc_reader_next(struct aoc_reader *r, char const **data, size_t *len)
+{
+    /* keep only the unfinished tail behind the span handed out last time */
+    r->len -= r->used;
+    memmove(r->buf, r->buf + r->used, r->len);
+    r->used = 0;
+    while (!r->eof)
+    {
+        if (r->len == r->cap)
+        {
+            AOC_ALLOC("reader buffer growth", r->cap * 2);
+            if (!(r->buf = realloc(r->buf, r->cap *= 2)))
+            {
+                fprintf(stderr, "[ERROR:] Memory Error, stream buffer not grown\n");
+                exit(2);
+            }
+        }
+        size_t const old = r->len;
+        ssize_t const n = read(r->fd, r->buf + r->len, r->cap - r->len);
+        if (n <= 0)
+        {
+            r->eof = true;
+            break;
+        }
+        r->len += n;
+        for (size_t i = r->len; i > old; i--) /* end of the last complete line */
+        {
+            if (r->buf[i - 1] == '\n')
+            {
+                r->used = i;
+                break;
+            }
+        }
+        if (r->used)
+        {
+            break;
+        }
+    }
+    if (r->eof)
+    {
+        r->used = r->len; /* the last line may lack a newline */
+    }
+    *data = r->buf;
+    *len = r->used;
+    return r->used > 0;
+}
+
+void aoc_reader_close(struct aoc_reader *r)
+{
+    if (r->fd != STDIN_FILENO)
+    {
+        close(r->fd);
+    }
+    free(r->buf);
+    r->buf = NULL;
+}
+
+/* A buffer of the read-ahead ring */
+struct slot {
+    char *buf;
+    size_t cap;
+    size_t len; /* complete lines in buf */
+    enum {SLOT_FREE, SLOT_FULL, SLOT_BUSY} state;
+};
+
+/*
+  The reader fills the slots in ring order and the workers take them in the same
+  order, so the full slots always follow next_take. One lock and one condition
+  variable guard the slot states; the data itself is only touched by the owner.
+ */
+struct pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct slot *slots;
+    int nslots;
+    int next_take;
+    bool done; /* nothing more will be read */
+    aoc_span_fn fn;
+    void *ctx;
+};
+
+struct pipeline_worker {
+    struct pipeline *p;
+    int id;
+};
+
+static void *pipeline_work(void *arg)
+{
+    struct pipeline_worker const *w = arg;
+    struct pipeline *const p = w->p;
+    pthread_mutex_lock(&p->lock);
+    for (;;)
+    {
+        struct slot *const s = &p->slots[p->next_take];
+        if (s->state == SLOT_FULL)
+        {
+            s->state = SLOT_BUSY;
+            p->next_take = (p->next_take + 1) % p->nslots;
+            pthread_mutex_unlock(&p->lock);
+            p->fn(p->ctx, s->buf, s->len, w->id);
+            pthread_mutex_lock(&p->lock);
+            s->state = SLOT_FREE;
+            pthread_cond_broadcast(&p->changed);
+        }
+        else if (p->done)
+        {
+            break;
+        }
+        else
+        {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Helper function for aoc_read_ahead: fill a buffer, fully unless the input ends */
+static bool pipeline_fill(int fd, bool seekable, off_t *offset, char *buf, size_t want, size_t *len)
+{
+    while (*len < want)
+    {
+        ssize_t const n = seekable ? pread(fd, buf + *len, want - *len, *offset) : read(fd, buf + *len, want - *len);
+        if (n <= 0)
+        {
+            return false;
+        }
+        *len += n;
+        *offset += n;
+    }
+    return true;
+}
+
+void aoc_read_ahead(char const *fname, int nworkers, aoc_span_fn fn, void *ctx)
+{
+    int const fd = input_fd(fname);
+    struct stat st;
+    bool const seekable = !fstat(fd, &st) && S_ISREG(st.st_mode);
+    nworkers = nworkers < 1 ? 1 : (nworkers > MAX_WORKERS ? MAX_WORKERS : nworkers);
+    struct pipeline p = {
+        .slots = calloc(nworkers + READ_AHEAD_SPARE, sizeof(struct slot)),
+        .nslots = nworkers + READ_AHEAD_SPARE,
+        .next_take = 0,
+        .done = false,
+        .fn = fn,
+        .ctx = ctx
+    };
+    if (!p.slots)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, read-ahead ring not created\n");
+        exit(2);
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+    struct pipeline_worker workers[MAX_WORKERS];
+    pthread_t tid[MAX_WORKERS];
+    int started = 0;
+    for (; started < nworkers; started++)
+    {
+        workers[started] = (struct pipeline_worker) {.p = &p, .id = started};
+        if (pthread_create(&tid[started], NULL, pipeline_work, &workers[started]))
+        {
+            break;
+        }
+    }
+
+    char *carry = NULL; /* the unfinished line at the end of the last buffer */
+    size_t carry_len = 0;
+    off_t offset = 0;
+    bool more = true;
+    for (int k = 0; more;)
+    {
+        struct slot *const s = &p.slots[k];
+        pthread_mutex_lock(&p.lock);
+        while (s->state != SLOT_FREE)
+        {
+            AOC_COUNT("read-ahead reader waits", 1); /* the parsers are behind */
+            pthread_cond_wait(&p.changed, &p.lock);
+        }
+        pthread_mutex_unlock(&p.lock);
+
+        size_t const want = carry_len + READ_AHEAD_BLOCK;
+        if (s->cap < want)
+        {
+            AOC_ALLOC("read-ahead buffers", want);
+            if (!(s->buf = realloc(s->buf, s->cap = want)))
+            {
+                break;
+            }
+        }
+        if (carry_len)
+        {
+            memcpy(s->buf, carry, carry_len);
+        }
+        size_t len = carry_len;
+        more = pipeline_fill(fd, seekable, &offset, s->buf, want, &len);
+        size_t cut = len; /* everything once the input has ended */
+        while (more && cut > 0 && s->buf[cut - 1] != '\n')
+        {
+            cut--;
+        }
+        carry_len = len - cut;
+        if (carry_len)
+        {
+            if (!(carry = realloc(carry, carry_len)))
+            {
+                break;
+            }
+            memcpy(carry, s->buf + cut, carry_len);
+        }
+        s->len = cut;
+        if (!cut)
+        {
+            continue; /* no complete line yet: refill the same buffer, bigger */
+        }
+        AOC_COUNT("read-ahead blocks", 1);
+        if (!started) /* no worker thread: parse in place */
+        {
+            fn(ctx, s->buf, s->len, 0);
+        }
+        else
+        {
+            pthread_mutex_lock(&p.lock);
+            s->state = SLOT_FULL;
+            pthread_cond_broadcast(&p.changed);
+            pthread_mutex_unlock(&p.lock);
+        }
+        k = (k + 1) % p.nslots;
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.done = true;
+    pthread_cond_broadcast(&p.changed);
+    pthread_mutex_unlock(&p.lock);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tid[i], NULL);
+    }
+    bool const failed = more; /* left the loop before the end of the input */
+    for (int i = 0; i < p.nslots; i++)
+    {
+        free(p.slots[i].buf);
+    }
+    free(p.slots);
+    free(carry);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.changed);
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    if (failed)
+    {
+        fprintf(stderr, "[ERROR:] Memory Error, %s not read\n", fname);
+        exit(2);
+    }
+}
+
+void aoc_split_lines(char const *data, size_t len, int n, struct aoc_span *ranges)
+{
+    char const *const end = data + len;
+    char const *beg = data;
+    for (int i = 0; i < n; i++)
+    {
+        char const *cut = (i == n - 1) ? end : data + len / n * (i + 1);
+        if (cut < beg)
+        {
+            cut = beg;
+        }
+        if (cut < end)
+        {
+            char const *eol = memchr(cut, '\n', end - cut);
+            cut = eol ? eol + 1 : end;
+        }
+        ranges[i] = (struct aoc_span) {.data = beg, .len = cut - beg};
+        beg = cut;
+    }
+}
+
+/* A range handed to one thread of aoc_parallel_lines */
+struct range_job {
+    struct aoc_span range;
+    aoc_span_fn fn;
+    void *ctx;
+    int worker;
+};
+
+static void *range_job_run(void *arg)
+{
+    struct range_job const *j = arg;
+    j->fn(j->ctx, j->range.data, j->range.len, j->worker);
+    return NULL;
+}
+
+void aoc_parallel_lines(char const *data, size_t len, int nworkers, aoc_span_fn fn, void *ctx)
+{
+    nworkers = nworkers < 1 ? 1 : (nworkers > MAX_WORKERS ? MAX_WORKERS : nworkers);
+    struct aoc_span ranges[MAX_WORKERS];
+    struct range_job jobs[MAX_WORKERS];
+    pthread_t tid[MAX_WORKERS];
+    aoc_split_lines(data, len, nworkers, ranges);
+    for (int i = 0; i < nworkers; i++)
+    {
+        jobs[i] = (struct range_job) {.range = ranges[i], .fn = fn, .ctx = ctx, .worker = i};
+    }
+
+    int started = 0;
+    for (; started < nworkers; started++)
+    {
+        if (pthread_create(&tid[started], NULL, range_job_run, &jobs[started]))
+        {
+            break;
+        }
+    }
+    for (int i = started; i < nworkers; i++)
+    {
+        range_job_run(&jobs[i]); /* could not start a thread: do the work here */
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tid[i], NULL);
+    }
+}
@@ -0,0 +1,121 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Input layer shared by the 2023 solutions. Compile aoc-input.c with the day, e.g.
+  clang -std=c99 -Wall -Wextra -pthread aoc-23-d1.c aoc-input.c  -O3 -g -o ../build/aoc-23-d1
+  (-pthread is needed by aoc_read_ahead and aoc_parallel_lines)
+
+  aoc_input_open hands a solver the whole input as one contiguous span of bytes:
+  regular files are mapped (with a sequential access hint), pipes and standard input
+  ("-") are read in large blocks into one buffer. aoc_lines walks a span line by
+  line. aoc_reader is for inputs that should not be held whole: each call returns
+  the next span of complete lines read so far. aoc_read_ahead hands such spans to
+  parser threads while the following ones are being read. aoc_split_lines and
+  aoc_parallel_lines share an input already held whole between threads.
+
+  Errors are reported on stderr and end the program, as everywhere else in the
+  solutions.
+ */
+
+#ifndef AOC_INPUT_H
+#define AOC_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define AOC_INPUT_WRITABLE 1 /* data may be written: a private copy, the file never changes */
+
+struct aoc_input {
+    char const *data;
+    size_t len;
+    size_t map_len; /* length of the mapping data points into, 0 when data was read */
+    char *buf; /* the buffer data points into when it was read, NULL otherwise */
+};
+
+struct aoc_input aoc_input_open(char const *fname, int flags);
+void aoc_input_close(struct aoc_input *in);
+
+/* Line iterator over a span; lines exclude their newline, an unterminated last line counts */
+struct aoc_lines {
+    char const *p;
+    char const *end;
+};
+
+static inline struct aoc_lines aoc_lines_of(char const *data, size_t len)
+{
+    struct aoc_lines it = {data, data + len};
+    return it;
+}
+
+static inline bool aoc_lines_next(struct aoc_lines *it, char const **line, size_t *len)
+{
+    if (it->p >= it->end)
+    {
+        return false;
+    }
+    char const *eol = memchr(it->p, '\n', it->end - it->p);
+    if (!eol)
+    {
+        eol = it->end;
+    }
+    *line = it->p;
+    *len = eol - it->p;
+    it->p = eol + (eol < it->end);
+    return true;
+}
+
+/*
+  Streaming reader: a buffer holding at least one line is refilled with read and
+  every call to aoc_reader_next returns the complete lines it holds, the last one
+  possibly unterminated at the end of the input. A span stays valid until the next
+  call.
+ */
+struct aoc_reader {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t len; /* bytes in buf */
+    size_t used; /* bytes already handed out */
+    bool eof;
+};
+
+struct aoc_reader aoc_reader_open(char const *fname);
+bool aoc_reader_next(struct aoc_reader *r, char const **data, size_t *len);
+void aoc_reader_close(struct aoc_reader *r);
+
+/*
+  Read-ahead pipeline: the calling thread reads the input into a ring of large
+  buffers, pread at explicit offsets for regular files and read otherwise, while
+  nworkers threads call fn on the buffers already filled, each holding complete
+  lines only. Spans arrive in no particular order; worker is the index of the thread
+  calling fn, between 0 and nworkers - 1, so partial answers can be kept per worker
+  without locking. Reading and parsing overlap, the wall time tends to the larger of
+  the two instead of their sum.
+ */
+typedef void (*aoc_span_fn)(void *ctx, char const *data, size_t len, int worker);
+
+void aoc_read_ahead(char const *fname, int nworkers, aoc_span_fn fn, void *ctx);
+
+/* A range of whole lines within a span */
+struct aoc_span {
+    char const *data;
+    size_t len;
+};
+
+/*
+  Split data into n ranges of about len / n bytes, each cut moved forward to just
+  after a newline so that no line is shared; ranges may be empty, together they
+  cover data in order.
+ */
+void aoc_split_lines(char const *data, size_t len, int n, struct aoc_span *ranges);
+
+/*
+  Split data with aoc_split_lines and call fn on range i from worker i, one thread
+  per range, returning once every range is done. A thread that cannot be started has
+  its range handled by the calling thread, with the same worker index.
+ */
+void aoc_parallel_lines(char const *data, size_t len, int nworkers, aoc_span_fn fn, void *ctx);
+
+#endif /* AOC_INPUT_H */
@@ -0,0 +1,138 @@
+/*  -*- mode: C -*- */
+/* This file conforms to C99 */
+
+/*
+  Hot path instrumentation shared by the 2023 solutions. Nothing here exists unless
+  the program is built with -DAOC_INSTRUMENT, e.g.
+  clang -std=c99 -Wall -Wextra -pthread -DAOC_INSTRUMENT aoc-23-d1.c aoc-input.c  -O3 -g -o ../build/aoc-23-d1-instr
+  Otherwise every macro expands to nothing and its arguments are not evaluated.
+
+  AOC_COUNT(name, n)        adds n to the counter name
+  AOC_ALLOC(name, bytes)    counts one allocation of bytes under name
+  AOC_PHASE_BEGIN(phase)    starts timing phase, an identifier
+  AOC_PHASE_END(phase)      adds the cycles since AOC_PHASE_BEGIN(phase), same scope
+  AOC_INSTR(...)            its arguments, statements kept only when instrumenting,
+                            e.g. for a local count added once at the end of a loop
+
+  Each site is a static record added with __atomic builtins, so worker threads may
+  share it; the hottest loops should still count locally and add once. At exit the
+  records are summed by name and printed on stderr with the peak resident set size,
+  so the answers on stdout are left alone. Cycles are read with rdtsc on x86 and are
+  clock() ticks elsewhere.
+ */
+
+#ifndef AOC_INSTR_H
+#define AOC_INSTR_H
+
+#ifdef AOC_INSTRUMENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+struct aoc_instr_site {
+    char const *name;
+    unsigned long long count;
+    unsigned long long bytes;
+    unsigned long long cycles;
+    int linked;
+    struct aoc_instr_site *next;
+};
+
+/* One list for the whole program: the weak definitions of every file are merged */
+__attribute__((weak)) struct aoc_instr_site *aoc_instr_sites;
+__attribute__((weak)) int aoc_instr_dump_armed;
+
+static inline unsigned long long aoc_instr_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return (unsigned long long) clock();
+#endif
+}
+
+static inline void aoc_instr_dump(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(stderr, "[INSTR:] peak RSS %li KiB\n", (long) ru.ru_maxrss);
+    fprintf(stderr, "[INSTR:] %-28s %14s %16s %18s\n", "site", "count", "bytes", "cycles");
+    for (struct aoc_instr_site *s = aoc_instr_sites; s; s = s->next)
+    {
+        if (!s->name)
+        {
+            continue; /* already added to an earlier site of the same name */
+        }
+        unsigned long long count = s->count;
+        unsigned long long bytes = s->bytes;
+        unsigned long long cycles = s->cycles;
+        for (struct aoc_instr_site *t = s->next; t; t = t->next)
+        {
+            if (t->name && !strcmp(t->name, s->name))
+            {
+                count += t->count;
+                bytes += t->bytes;
+                cycles += t->cycles;
+                t->name = NULL;
+            }
+        }
+        fprintf(stderr, "[INSTR:] %-28s %14llu %16llu %18llu\n", s->name, count, bytes, cycles);
+    }
+}
+
+/* Link a site into the list the first time it is reached, arming the dump once */
+static inline void aoc_instr_link(struct aoc_instr_site *s)
+{
+    if (__atomic_exchange_n(&s->linked, 1, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+    s->next = __atomic_load_n(&aoc_instr_sites, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&aoc_instr_sites, &s->next, s, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+    }
+    if (!__atomic_exchange_n(&aoc_instr_dump_armed, 1, __ATOMIC_ACQ_REL))
+    {
+        atexit(aoc_instr_dump);
+    }
+}
+
+static inline void aoc_instr_add(struct aoc_instr_site *s, unsigned long long count, unsigned long long bytes,
+                                 unsigned long long cycles)
+{
+    if (!__atomic_load_n(&s->linked, __ATOMIC_RELAXED))
+    {
+        aoc_instr_link(s);
+    }
+    __atomic_add_fetch(&s->count, count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->cycles, cycles, __ATOMIC_RELAXED);
+}
+
+#define AOC_INSTR_SITE(name, count, bytes, cycles)                                 \
+    do                                                                             \
+    {                                                                              \
+        static struct aoc_instr_site aoc_instr_site_ = {name, 0, 0, 0, 0, NULL};   \
+        aoc_instr_add(&aoc_instr_site_, (count), (bytes), (cycles));               \
+    } while (0)
+
+#define AOC_COUNT(name, n) AOC_INSTR_SITE(name, (n), 0, 0)
+#define AOC_ALLOC(name, bytes) AOC_INSTR_SITE(name, 1, (bytes), 0)
+#define AOC_PHASE_BEGIN(phase) unsigned long long const aoc_instr_phase_##phase = aoc_instr_cycles()
+#define AOC_PHASE_END(phase) AOC_INSTR_SITE("phase " #phase, 1, 0, aoc_instr_cycles() - aoc_instr_phase_##phase)
+#define AOC_INSTR(...) __VA_ARGS__
+
+#else
+
+#define AOC_COUNT(name, n) ((void) 0)
+#define AOC_ALLOC(name, bytes) ((void) 0)
+#define AOC_PHASE_BEGIN(phase) ((void) 0)
+#define AOC_PHASE_END(phase) ((void) 0)
+#define AOC_INSTR(...)
+
+#endif /* AOC_INSTRUMENT */
+
+#endif /* AOC_INSTR_H */